@@ -0,0 +1,153 @@
+/* ******************************************************************
+   Event queue benchmark: the original sorted doubly-linked event list
+   against the heap in evqueue.c.
+
+   Uses the classic "hold" model: the queue is filled to a fixed depth,
+   then every operation pops the earliest event and schedules it again
+   a random interval in the future, as the emulator main loop does.
+
+   Build from this directory with:
+     gcc -O2 -I.. -o evqueue_bench evqueue_bench.c ../evqueue.c
+**********************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include "evqueue.h"
+
+/* small private generator so both queues see the same schedule */
+static unsigned long rngstate;
+
+static double uniform(void)
+{
+  rngstate = rngstate * 6364136223846793005UL + 1442695040888963407UL;
+  return (double)(rngstate >> 11) / 9007199254740992.0;
+}
+
+/********* the sorted list, as it was in emulator.c ************/
+
+struct lnode {
+  float evtime;
+  struct lnode *prev;
+  struct lnode *next;
+};
+
+static struct lnode *evlist = NULL;
+
+static void list_insert(struct lnode *p)
+{
+  struct lnode *q, *qold;
+
+  q = evlist;
+  if (q == NULL) {
+    evlist = p;
+    p->next = NULL;
+    p->prev = NULL;
+  }
+  else {
+    for (qold = q; q != NULL && p->evtime > q->evtime; q = q->next)
+      qold = q;
+    if (q == NULL) {
+      qold->next = p;
+      p->prev = qold;
+      p->next = NULL;
+    }
+    else if (q == evlist) {
+      p->next = evlist;
+      p->prev = NULL;
+      p->next->prev = p;
+      evlist = p;
+    }
+    else {
+      p->next = q;
+      p->prev = q->prev;
+      q->prev->next = p;
+      q->prev = p;
+    }
+  }
+}
+
+static struct lnode *list_pop(void)
+{
+  struct lnode *p = evlist;
+
+  evlist = evlist->next;
+  if (evlist != NULL)
+    evlist->prev = NULL;
+  return p;
+}
+
+static double seconds(void)
+{
+  return (double)clock() / CLOCKS_PER_SEC;
+}
+
+static double bench_list(int depth, long ops)
+{
+  struct lnode *nodes, *p;
+  double start, elapsed;
+  long i;
+
+  nodes = malloc(depth * sizeof(struct lnode));
+  rngstate = 9999;
+  for (i = 0; i < depth; i++) {
+    nodes[i].evtime = (float)(10.0 * uniform());
+    list_insert(&nodes[i]);
+  }
+  start = seconds();
+  for (i = 0; i < ops; i++) {
+    p = list_pop();
+    p->evtime += (float)(1.0 + 9.0 * uniform());
+    list_insert(p);
+  }
+  elapsed = seconds() - start;
+  evlist = NULL;
+  free(nodes);
+  return ops / elapsed;
+}
+
+static double bench_heap(int depth, long ops)
+{
+  struct evqueue q;
+  struct event *events, *p;
+  double start, elapsed;
+  long i;
+
+  events = malloc(depth * sizeof(struct event));
+  evq_init(&q);
+  rngstate = 9999;
+  for (i = 0; i < depth; i++) {
+    events[i].evtime = (float)(10.0 * uniform());
+    evq_push(&q, &events[i]);
+  }
+  start = seconds();
+  for (i = 0; i < ops; i++) {
+    p = evq_pop(&q);
+    p->evtime += (float)(1.0 + 9.0 * uniform());
+    evq_push(&q, p);
+  }
+  elapsed = seconds() - start;
+  evq_free(&q);
+  free(events);
+  return ops / elapsed;
+}
+
+int main(void)
+{
+  static const int depths[] = { 4, 16, 64, 256, 1024, 4096, 16384 };
+  double list_rate, heap_rate;
+  long ops;
+  int i;
+
+  printf("%8s %16s %16s %8s\n", "depth", "list events/s", "heap events/s", "speedup");
+  for (i = 0; i < (int)(sizeof(depths) / sizeof(depths[0])); i++) {
+    /* keep the list runs to a similar wall time at every depth */
+    ops = 200000000L / (depths[i] + 16);
+    if (ops > 2000000L)
+      ops = 2000000L;
+    list_rate = bench_list(depths[i], ops);
+    heap_rate = bench_heap(depths[i], ops);
+    printf("%8d %16.0f %16.0f %7.1fx\n", depths[i], list_rate, heap_rate,
+           heap_rate / list_rate);
+  }
+  return EXIT_SUCCESS;
+}
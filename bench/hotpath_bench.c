@@ -0,0 +1,361 @@
+/* ******************************************************************
+   Hot path benchmark of the emulator and the protocols, with its
+   results as one JSON object on stdout:
+
+   - checksum: pkt_checksum() per packet, at a few payload lengths
+   - evqueue: pop and push again at a fixed queue depth (the "hold"
+   model of evqueue_bench.c), with nodes from the event pool
+   - timers: a starttimer_id()/stoptimer_id() pair, with a number of
+   other timers pending
+   - tolayer3: one packet into the medium, by value and in place, with
+   and without loss and corruption
+   - round_trip: whole SR runs, A_output() to B_input() to A_input(),
+   at several window sizes and loss rates, as events per second
+
+   The emulator routines are called between runs, on a simulation that
+   a run of no messages has set up; a run of no messages also clears
+   what they leave in the event queue.
+
+   usage: hotpath_bench [--scale S] [--baseline FILE] [--tolerance T]
+   --scale multiplies the work done (default 1).  With --baseline, the
+   events per second of this run are compared with those saved in FILE
+   by an earlier one, and the exit status is 1 if any fell by more
+   than T (default 0.1, that is 10%).
+
+   Build with the Makefile in this directory, or from it with:
+     gcc -O2 -I.. -pthread -DEMULATOR_NO_MAIN -o hotpath_bench hotpath_bench.c ../emulator.c ../evqueue.c ../trace.c ../evlog.c ../rng.c ../checksum.c ../sendq.c ../histogram.c ../bitmap.c ../channel.c ../checkpoint.c ../gbn.c ../sr.c -lm
+**********************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "emulator.h"
+#include "evqueue.h"
+#include "checksum.h"
+
+#define MAXRATES 64
+#define BATCH 1024          /* packets sent into the medium between resets */
+
+static double scale = 1.0;
+
+/* the events per second measured, in the order they are printed, and what of */
+static double rates[MAXRATES];
+static char what[MAXRATES][48];
+static int nrates = 0;
+
+/* small private generator so every run sees the same schedule */
+static unsigned long rngstate = 1;
+
+static unsigned long next(void)
+{
+  rngstate = rngstate * 6364136223846793005UL + 1442695040888963407UL;
+  return rngstate >> 33;
+}
+
+static double seconds(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long scaled(long n)
+{
+  n = (long)(n * scale);
+  return n > 0 ? n : 1;
+}
+
+static void keep_rate(double rate, const char *name, const char *param, const char *value)
+{
+  if (nrates < MAXRATES) {
+    sprintf(what[nrates], "%s %s %s", name, param, value);
+    rates[nrates++] = rate;
+  }
+}
+
+static void set(struct simulation *sim, const char *name, const char *value)
+{
+  if (!sim_setting(sim, name, value)) {
+    printf("bad setting %s=%s\n", name, value);
+    exit(EXIT_FAILURE);
+  }
+}
+
+/* a simulation set up by a run of no messages, quiet and with the given channel */
+static struct simulation *idle_sim(const char *loss, const char *corrupt)
+{
+  struct simulation *sim = sim_create();
+
+  set(sim, "msgs", "0");
+  set(sim, "loss", loss);
+  set(sim, "corrupt", corrupt);
+  set(sim, "direction", "2");
+  set(sim, "lambda", "10");
+  set(sim, "trace", "0");
+  sim_run(sim);
+  return sim;
+}
+
+static void fill(struct pkt *p, int length)
+{
+  int i;
+
+  p->seqnum = (int)(next() % 64);
+  p->acknum = (int)(next() % 64);
+  p->length = length;
+  p->more = 0;
+  for (i = 0; i < length; i++)
+    p->payload[i] = (char)('a' + next() % 26);
+  p->checksum = 0;
+}
+
+static void bench_checksum(void)
+{
+  static const int lengths[] = { 0, 8, 20, 64, 256, 1460 };
+  static struct pkt pkts[256];
+  double t, ns;
+  long r, rounds;
+  int i, k, first = 1;
+  volatile int sink = 0;
+
+  printf("  \"checksum\": [");
+  for (k = 0; k < (int)(sizeof(lengths) / sizeof(lengths[0])); k++) {
+    if (lengths[k] > MAXPAYLOAD)
+      continue;
+    for (i = 0; i < 256; i++)
+      fill(&pkts[i], lengths[k]);
+    rounds = scaled(20000000L / (lengths[k] + 32));
+    t = seconds();
+    for (r = 0; r < rounds; r++)
+      for (i = 0; i < 256; i++)
+        sink += pkt_checksum(&pkts[i]);
+    ns = (seconds() - t) * 1e9 / ((double)rounds * 256);
+    printf("%s\n    { \"length\": %d, \"ns_per_packet\": %.2f }", first ? "" : ",", lengths[k], ns);
+    first = 0;
+  }
+  printf("\n  ],\n");
+}
+
+static void bench_evqueue(void)
+{
+  static const int depths[] = { 16, 256, 4096, 65536 };
+  struct evqueue q;
+  struct event *p;
+  char depth[16];
+  double t, rate;
+  long i, ops;
+  int k;
+
+  printf("  \"evqueue\": [");
+  for (k = 0; k < (int)(sizeof(depths) / sizeof(depths[0])); k++) {
+    evq_init(&q);
+    for (i = 0; i < depths[k]; i++) {
+      p = evq_alloc(&q);
+      p->evtime = (float)(10.0 * (next() % 1000) / 1000.0);
+      evq_push(&q, p);
+    }
+    ops = scaled(4000000L);
+    t = seconds();
+    for (i = 0; i < ops; i++) {
+      p = evq_pop(&q);
+      p->evtime += (float)(1.0 + 9.0 * (next() % 1000) / 1000.0);
+      evq_push(&q, p);
+    }
+    rate = ops / (seconds() - t);
+    evq_free(&q);
+    sprintf(depth, "%d", depths[k]);
+    keep_rate(rate, "evqueue", "depth", depth);
+    printf("%s\n    { \"depth\": %d, \"events_per_sec\": %.0f }", k ? "," : "", depths[k], rate);
+  }
+  printf("\n  ],\n");
+}
+
+static void bench_timers(void)
+{
+  static const int pending[] = { 0, 64, 4096 };
+  struct simulation *sim;
+  double t, ns;
+  long i, ops;
+  int k, id;
+
+  printf("  \"timers\": [");
+  for (k = 0; k < (int)(sizeof(pending) / sizeof(pending[0])); k++) {
+    sim = idle_sim("0", "0");
+    for (id = 0; id < pending[k]; id++)
+      starttimer_id(sim, A, id, 10.0 + (next() % 1000) / 10.0);
+    ops = scaled(4000000L);
+    t = seconds();
+    for (i = 0; i < ops; i++) {
+      starttimer_id(sim, A, pending[k], 50.0);
+      stoptimer_id(sim, A, pending[k]);
+    }
+    ns = (seconds() - t) * 1e9 / ops;
+    sim_destroy(sim);
+    printf("%s\n    { \"pending\": %d, \"ns_per_start_stop\": %.2f }", k ? "," : "", pending[k], ns);
+  }
+  printf("\n  ],\n");
+}
+
+static void bench_tolayer3(void)
+{
+  static const char *const channels[][2] = { { "0", "0" }, { "0.2", "0.2" }, { "1", "0" } };
+  struct simulation *sim;
+  struct pkt packet, *p;
+  double t, elapsed[2];
+  long b, batches;
+  int i, k, inplace;
+
+  printf("  \"tolayer3\": [");
+  for (k = 0; k < (int)(sizeof(channels) / sizeof(channels[0])); k++) {
+    sim = idle_sim(channels[k][0], channels[k][1]);
+    fill(&packet, 20);
+    batches = scaled(2000L);
+    for (inplace = 0; inplace < 2; inplace++) {
+      elapsed[inplace] = 0.0;
+      for (b = 0; b < batches; b++) {
+        t = seconds();
+        if (inplace)
+          for (i = 0; i < BATCH; i++) {
+            p = pkt_alloc(sim);
+            *p = packet;
+            tolayer3_pkt(sim, A, p);
+          }
+        else
+          for (i = 0; i < BATCH; i++)
+            tolayer3(sim, A, packet);
+        elapsed[inplace] += seconds() - t;
+        sim_run(sim);         /* empties the medium again */
+      }
+    }
+    sim_destroy(sim);
+    printf("%s\n    { \"loss\": %s, \"corrupt\": %s, \"ns_per_packet\": %.2f, \"ns_per_packet_in_place\": %.2f }",
+           k ? "," : "", channels[k][0], channels[k][1],
+           elapsed[0] * 1e9 / ((double)batches * BATCH), elapsed[1] * 1e9 / ((double)batches * BATCH));
+  }
+  printf("\n  ],\n");
+}
+
+static void bench_round_trip(void)
+{
+  static const char *const windows[] = { "4", "16", "64" };
+  static const char *const losses[] = { "0", "0.1", "0.3" };
+  struct simulation *sim;
+  const struct sim_stats *st;
+  char msgs[32], point[32];
+  double t, elapsed, rate;
+  int w, l;
+
+  sprintf(msgs, "%ld", scaled(100000L));
+  printf("  \"round_trip\": [");
+  for (w = 0; w < (int)(sizeof(windows) / sizeof(windows[0])); w++)
+    for (l = 0; l < (int)(sizeof(losses) / sizeof(losses[0])); l++) {
+      sim = sim_create();
+      set(sim, "msgs", msgs);
+      set(sim, "loss", losses[l]);
+      set(sim, "corrupt", losses[l]);
+      set(sim, "direction", "2");
+      set(sim, "lambda", "2");
+      set(sim, "trace", "0");
+      set(sim, "window", windows[w]);
+      set(sim, "queue", "1000");
+      t = seconds();
+      sim_run(sim);
+      elapsed = seconds() - t;
+      st = sim_stats(sim);
+      rate = st->nevents / elapsed;
+      sprintf(point, "%s loss %s", windows[w], losses[l]);
+      keep_rate(rate, "round_trip", "window", point);
+      printf("%s\n    { \"protocol\": \"sr\", \"window\": %s, \"loss\": %s, \"corrupt\": %s, "
+             "\"messages_delivered\": %d, \"events\": %d, \"events_per_sec\": %.0f, "
+             "\"ns_per_message\": %.1f }",
+             w || l ? "," : "", windows[w], losses[l], losses[l], st->messages_delivered,
+             st->nevents, rate, st->messages_delivered > 0 ? elapsed * 1e9 / st->messages_delivered : 0.0);
+      sim_destroy(sim);
+    }
+  printf("\n  ]\n");
+}
+
+/* the events per second saved in a file written by an earlier run, in order */
+static int read_baseline(const char *path, double *saved)
+{
+  static const char key[] = "\"events_per_sec\": ";
+  FILE *f;
+  char *text, *p;
+  long size;
+  int n = 0;
+
+  f = fopen(path, "rb");
+  if (f == NULL) {
+    fprintf(stderr, "cannot open baseline %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  fseek(f, 0, SEEK_END);
+  size = ftell(f);
+  rewind(f);
+  text = malloc(size + 1);
+  if (text == NULL || fread(text, 1, size, f) != (size_t)size) {
+    fprintf(stderr, "cannot read baseline %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  text[size] = '\0';
+  fclose(f);
+  for (p = strstr(text, key); p != NULL && n < MAXRATES; p = strstr(p, key)) {
+    p += sizeof(key) - 1;
+    saved[n++] = strtod(p, NULL);
+  }
+  free(text);
+  return n;
+}
+
+/* 1 if a rate fell by more than tolerance from the baseline; on stderr, */
+/* so that stdout stays JSON                                             */
+static int regressed(const char *path, double tolerance)
+{
+  double saved[MAXRATES];
+  int i, n, worse = 0;
+
+  n = read_baseline(path, saved);
+  if (n != nrates) {
+    fprintf(stderr, "baseline %s has %d rates, this run %d: not comparable\n", path, n, nrates);
+    return 1;
+  }
+  for (i = 0; i < n; i++)
+    if (rates[i] < saved[i] * (1.0 - tolerance)) {
+      fprintf(stderr, "%s: %.0f events/s, down from %.0f\n", what[i], rates[i], saved[i]);
+      worse = 1;
+    }
+  return worse;
+}
+
+int main(int argc, char **argv)
+{
+  const char *baseline = NULL;
+  double tolerance = 0.1;
+  int i;
+
+  for (i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc)
+      scale = atof(argv[++i]);
+    else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc)
+      baseline = argv[++i];
+    else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc)
+      tolerance = atof(argv[++i]);
+    else {
+      fprintf(stderr, "usage: %s [--scale S] [--baseline FILE] [--tolerance T]\n", argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  printf("{\n");
+  printf("  \"maxpayload\": %d,\n", MAXPAYLOAD);
+  printf("  \"scale\": %g,\n", scale);
+  bench_checksum();
+  bench_evqueue();
+  bench_timers();
+  bench_tolayer3();
+  bench_round_trip();
+  printf("}\n");
+  fflush(stdout);
+  return baseline != NULL ? regressed(baseline, tolerance) : EXIT_SUCCESS;
+}
@@ -0,0 +1,261 @@
+/* ******************************************************************
+   Window scan benchmark: the per sequence number state arrays that
+   sr.c used to scan one slot at a time, against the bitmaps of
+   bitmap.c, at windows of 8 to 4096 packets.
+
+   The packets, and so their ACKs, arrive in the order they were sent,
+   except that each one is lost with probability loss, and each resend
+   of it too (up to twice), and arrives a third of a window later.
+
+   - sender: for each ACK, base moves past the run of ACKed packets it
+   starts, the fast retransmit test looks for an ACK beyond base, and
+   the window is filled again
+   - receiver: for each packet, the run of packets base starts is
+   delivered and the bitmap of a SACK for the window is built
+
+   Both versions see the same packets, and must agree on how far base
+   went and how many packets the SACKs listed.
+
+   Build from this directory with:
+     gcc -O2 -I.. -o window_bench window_bench.c ../bitmap.c
+**********************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "bitmap.h"
+
+/* small private generator for the losses */
+static unsigned long rngstate;
+
+static double uniform(void)
+{
+  rngstate = rngstate * 6364136223846793005UL + 1442695040888963407UL;
+  return (double)(rngstate >> 11) / 9007199254740992.0;
+}
+
+static double seconds(void)
+{
+  return (double)clock() / CLOCKS_PER_SEC;
+}
+
+/* a packet, and where in the order of arrivals it comes */
+struct arrival {
+  long when;
+  long seq;
+};
+
+static int by_when(const void *a, const void *b)
+{
+  const struct arrival *x = a, *y = b;
+
+  if (x->when != y->when)
+    return x->when < y->when ? -1 : 1;
+  return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+/* the sequence numbers of n packets of window, in the order they arrive. */
+/* With at most two losses a third of a window apart, a packet never      */
+/* arrives a window or more past the oldest one missing                    */
+static int *arrivals(int window, long n, double loss)
+{
+  struct arrival *a;
+  int *order;
+  long i, delay = window / 3 > 0 ? window / 3 : 1;
+  int lost;
+
+  a = malloc(n * sizeof(struct arrival));
+  order = malloc(n * sizeof(int));
+  if (a == NULL || order == NULL) {
+    printf("memory allocation for arrivals failed.");
+    exit(EXIT_FAILURE);
+  }
+  rngstate = 9999;
+  for (i = 0; i < n; i++) {
+    for (lost = 0; lost < 2 && uniform() < loss; lost++)
+      ;
+    a[i].when = i + lost * delay;
+    a[i].seq = i;
+  }
+  qsort(a, n, sizeof(struct arrival), by_when);
+  for (i = 0; i < n; i++)
+    order[i] = (int)(a[i].seq % (2 * window));
+  free(a);
+  return order;
+}
+
+/* the sequence space is twice the window, a power of two as here */
+#define SEQ(x) ((x) & mask)
+
+/********* the slot arrays, as they were in sr.c ************/
+
+enum PacketStatus {
+  NOT_SENT,
+  SENT_NOT_ACKED,
+  ACKED
+};
+
+static double sender_array(int window, const int *order, long ops, long *moved)
+{
+  enum PacketStatus *status;
+  int mask = 2 * window - 1, base = 0, nextseqnum, i;
+  double start, elapsed;
+  long k, beyond = 0;
+
+  status = calloc(2 * window, sizeof(enum PacketStatus));
+  for (nextseqnum = 0; nextseqnum < window; nextseqnum++)
+    status[nextseqnum] = SENT_NOT_ACKED;
+  *moved = 0;
+  start = seconds();
+  for (k = 0; k < ops; k++) {
+    status[order[k]] = ACKED;
+    while (status[base] == ACKED) {
+      status[base] = NOT_SENT;
+      base = SEQ(base + 1);
+      (*moved)++;
+    }
+    for (i = 1; i < window; i++)
+      if (status[SEQ(base + i)] == ACKED) {
+        beyond++;
+        break;
+      }
+    for (; SEQ(nextseqnum + 2 * window - base) < window; nextseqnum = SEQ(nextseqnum + 1))
+      status[nextseqnum] = SENT_NOT_ACKED;
+  }
+  elapsed = seconds() - start;
+  *moved += beyond;
+  free(status);
+  return ops / elapsed;
+}
+
+static double receiver_array(int window, const int *order, long ops, long *sacked)
+{
+  unsigned char *sack;
+  int *received;
+  int mask = 2 * window - 1, base = 0, i;
+  double start, elapsed;
+  long k;
+
+  received = calloc(2 * window, sizeof(int));
+  sack = malloc(window / 8 + 1);
+  *sacked = 0;
+  start = seconds();
+  for (k = 0; k < ops; k++) {
+    received[order[k]] = 1;
+    while (received[base] == 1) {
+      received[base] = 0;
+      base = SEQ(base + 1);
+    }
+    memset(sack, 0, window / 8 + 1);
+    for (i = 0; i < window - 1; i++)
+      if (received[SEQ(base + 1 + i)]) {
+        sack[i / 8] |= (unsigned char)(1 << (i % 8));
+        (*sacked)++;
+      }
+  }
+  elapsed = seconds() - start;
+  *sacked += base;
+  free(received);
+  free(sack);
+  return ops / elapsed;
+}
+
+/********* the bitmaps of sr.c ************/
+
+static double sender_bitmap(int window, const int *order, long ops, long *moved)
+{
+  uint64_t *outstanding, *acked;
+  int mask = 2 * window - 1, size = 2 * window, base = 0, nextseqnum, run;
+  double start, elapsed;
+  long k, beyond = 0;
+
+  outstanding = calloc(BM_WORDS(size), sizeof(uint64_t));
+  acked = calloc(BM_WORDS(size), sizeof(uint64_t));
+  for (nextseqnum = 0; nextseqnum < window; nextseqnum++)
+    bm_set(outstanding, nextseqnum);
+  *moved = 0;
+  start = seconds();
+  for (k = 0; k < ops; k++) {
+    bm_clear(outstanding, order[k]);
+    bm_set(acked, order[k]);
+    run = bm_clear_run(acked, size, base, window);
+    base = SEQ(base + run);
+    *moved += run;
+    if (bm_find(acked, size, SEQ(base + 1), window - 1, 1) < window - 1)
+      beyond++;
+    for (; SEQ(nextseqnum + 2 * window - base) < window; nextseqnum = SEQ(nextseqnum + 1))
+      bm_set(outstanding, nextseqnum);
+  }
+  elapsed = seconds() - start;
+  *moved += beyond;
+  free(outstanding);
+  free(acked);
+  return ops / elapsed;
+}
+
+static double receiver_bitmap(int window, const int *order, long ops, long *sacked)
+{
+  unsigned char *sack;
+  uint64_t *received;
+  int mask = 2 * window - 1, size = 2 * window, base = 0, run, n = window - 1;
+  double start, elapsed;
+  long k;
+
+  received = calloc(BM_WORDS(size), sizeof(uint64_t));
+  sack = malloc(window / 8 + 1);
+  *sacked = 0;
+  start = seconds();
+  for (k = 0; k < ops; k++) {
+    bm_set(received, order[k]);
+    run = bm_clear_run(received, size, base, window);
+    base = SEQ(base + run);
+    memset(sack, 0, window / 8 + 1);
+    *sacked += bm_copy(received, size, SEQ(base + 1), n, sack);
+  }
+  elapsed = seconds() - start;
+  *sacked += base;
+  free(received);
+  free(sack);
+  return ops / elapsed;
+}
+
+int main(void)
+{
+  static const int windows[] = { 8, 16, 64, 256, 1024, 4096 };
+  static const double losses[] = { 0.0, 0.1 };
+  double array_rate, bitmap_rate;
+  long ops, array_check, bitmap_check;
+  int i, j, w, *order;
+
+  printf("%8s %6s %9s %16s %16s %8s\n", "window", "loss", "side", "array ops/s",
+         "bitmap ops/s", "speedup");
+  for (i = 0; i < (int)(sizeof(windows) / sizeof(windows[0])); i++)
+    for (j = 0; j < (int)(sizeof(losses) / sizeof(losses[0])); j++) {
+      w = windows[i];
+      /* keep the array runs to a similar wall time at every window */
+      ops = 400000000L / (w + 16);
+      if (ops > 2000000L)
+        ops = 2000000L;
+      order = arrivals(w, ops, losses[j]);
+
+      array_rate = sender_array(w, order, ops, &array_check);
+      bitmap_rate = sender_bitmap(w, order, ops, &bitmap_check);
+      if (array_check != bitmap_check) {
+        printf("window %d: the sender versions disagree\n", w);
+        return EXIT_FAILURE;
+      }
+      printf("%8d %6.2f %9s %16.0f %16.0f %7.1fx\n", w, losses[j], "sender", array_rate,
+             bitmap_rate, bitmap_rate / array_rate);
+
+      array_rate = receiver_array(w, order, ops, &array_check);
+      bitmap_rate = receiver_bitmap(w, order, ops, &bitmap_check);
+      if (array_check != bitmap_check) {
+        printf("window %d: the receiver versions disagree\n", w);
+        return EXIT_FAILURE;
+      }
+      printf("%8d %6.2f %9s %16.0f %16.0f %7.1fx\n", w, losses[j], "receiver", array_rate,
+             bitmap_rate, bitmap_rate / array_rate);
+      free(order);
+    }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,142 @@
+/* ******************************************************************
+   Packed bitmaps over a circular sequence space.  A search skips a
+   whole word of bits that are all unwanted at once, and finds the
+   wanted bit of a word by counting its trailing zeros; a copy moves
+   up to a word of bits at a time, and counts them by population.
+**********************************************************************/
+#include "bitmap.h"
+
+#if defined(__GNUC__)
+#define ctz64(w) __builtin_ctzll(w)
+#define popcount64(w) __builtin_popcountll(w)
+#else
+static int ctz64(uint64_t w)
+{
+  int n = 0;
+
+  while (!(w & 1)) {
+    w >>= 1;
+    n++;
+  }
+  return n;
+}
+
+static int popcount64(uint64_t w)
+{
+  int n = 0;
+
+  for (; w != 0; w &= w - 1)
+    n++;
+  return n;
+}
+#endif
+
+/* the first bit equal to value in [from, end) of bm, end if none */
+static int find_linear(const uint64_t *bm, int from, int end, int value)
+{
+  uint64_t flip = value ? 0 : ~(uint64_t)0, w;
+  int i = from;
+
+  while (i < end) {
+    w = (bm[i / BM_BITS] ^ flip) >> (i % BM_BITS);
+    if (w != 0) {
+      i += ctz64(w);
+      return i < end ? i : end;
+    }
+    i = (i / BM_BITS + 1) * BM_BITS;
+  }
+  return end;
+}
+
+int bm_find(const uint64_t *bm, int size, int from, int n, int value)
+{
+  int end, i;
+
+  end = from + n < size ? from + n : size;
+  i = find_linear(bm, from, end, value);
+  if (i < end)
+    return i - from;
+  /* the rest of the range wraps around to the start */
+  return end - from + find_linear(bm, 0, n - (end - from), value);
+}
+
+/* clear the run of set bits that [from, end) of bm starts with; its length */
+static int clear_run_linear(uint64_t *bm, int from, int end)
+{
+  uint64_t w;
+  int i = from, shift, k;
+
+  while (i < end) {
+    shift = i % BM_BITS;
+    w = ~bm[i / BM_BITS] >> shift;    /* a bit of w is set for a clear one of bm */
+    k = w != 0 ? ctz64(w) : BM_BITS - shift;
+    if (k > end - i)
+      k = end - i;
+    if (k == BM_BITS)
+      bm[i / BM_BITS] = 0;
+    else
+      bm[i / BM_BITS] &= ~((((uint64_t)1 << k) - 1) << shift);
+    i += k;
+    if (w != 0)
+      break;
+  }
+  return i - from;
+}
+
+int bm_clear_run(uint64_t *bm, int size, int from, int n)
+{
+  int end, k;
+
+  end = from + n < size ? from + n : size;
+  k = clear_run_linear(bm, from, end);
+  if (from + k < end || k == n)
+    return k;
+  return k + clear_run_linear(bm, 0, n - k);
+}
+
+/* the k (1..64) bits of bm from bit i on, none of them past its end */
+static uint64_t get_linear(const uint64_t *bm, int i, int k)
+{
+  int shift = i % BM_BITS;
+  uint64_t w;
+
+  w = bm[i / BM_BITS] >> shift;
+  if (shift != 0 && shift + k > BM_BITS)
+    w |= bm[i / BM_BITS + 1] << (BM_BITS - shift);
+  return k == BM_BITS ? w : w & (((uint64_t)1 << k) - 1);
+}
+
+/* or the bits of w, k of them, into out from bit off on */
+static void put_bits(unsigned char *out, int off, uint64_t w, int k)
+{
+  int n;
+
+  while (k > 0) {
+    out[off / 8] |= (unsigned char)(w << (off % 8));
+    n = 8 - off % 8;
+    w >>= n;
+    off += n;
+    k -= n;
+  }
+}
+
+int bm_copy(const uint64_t *bm, int size, int from, int n, unsigned char *out)
+{
+  uint64_t w;
+  int i = from, k, done, count = 0;
+
+  for (done = 0; done < n; done += k) {
+    k = n - done < BM_BITS ? n - done : BM_BITS;
+    if (k > size - i)
+      k = size - i;
+    w = get_linear(bm, i, k);
+    if (w != 0) {
+      count += popcount64(w);
+      put_bits(out, done, w, k);
+    }
+    i += k;
+    if (i == size)
+      i = 0;
+  }
+  return count;
+}
@@ -0,0 +1,33 @@
+/* ******************************************************************
+   Packed bitmaps over a circular sequence space (see bitmap.c), for
+   the per packet state of the SR windows: one bit per sequence
+   number, so that the scans of a window take a word at a time.
+**********************************************************************/
+#ifndef BITMAP_H
+#define BITMAP_H
+
+#include <stdint.h>
+
+#define BM_BITS 64
+
+/* words for a bitmap of n bits */
+#define BM_WORDS(n)  (((n) + BM_BITS - 1) / BM_BITS)
+
+#define bm_test(bm, i)   ((int)(((bm)[(i) / BM_BITS] >> ((i) % BM_BITS)) & 1))
+#define bm_set(bm, i)    ((bm)[(i) / BM_BITS] |= (uint64_t)1 << ((i) % BM_BITS))
+#define bm_clear(bm, i)  ((bm)[(i) / BM_BITS] &= ~((uint64_t)1 << ((i) % BM_BITS)))
+
+/* A range is the n bits (n <= size) from bit from on, continuing at bit */
+/* 0 past the end of a bitmap of size bits, as sequence numbers do.      */
+
+/* offset within the range of the first bit equal to value, n if none */
+extern int bm_find(const uint64_t *bm, int size, int from, int n, int value);
+
+/* clear the run of set bits the range starts with; the number of them */
+extern int bm_clear_run(uint64_t *bm, int size, int from, int n);
+
+/* or the range into the bitmap of bytes out, bit i of the range going */
+/* to bit i % 8 of out[i / 8]; the number of set bits it holds          */
+extern int bm_copy(const uint64_t *bm, int size, int from, int n, unsigned char *out);
+
+#endif
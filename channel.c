@@ -0,0 +1,142 @@
+/* ******************************************************************
+   Link model of the medium: serialisation of packets at the link's
+   bandwidth, a drop-tail buffer, Gilbert-Elliott burst losses and the
+   propagation delay distributions of --delay.
+
+   Every delay distribution is 1 plus a non-negative part, so no packet
+   is in the medium for less than 1 time unit, as in the classic model;
+   the sharded runs of --threads count on that.
+**********************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <limits.h>
+#include "emulator.h"
+#include "checkpoint.h"
+#include "channel.h"
+
+#define PARETO_SHAPE 2.5    /* tail index of the pareto delays: finite mean and variance */
+
+void channel_reset(struct channel *c)
+{
+  c->busy = 0.0;
+  c->first = 0;
+  c->count = 0;
+  c->bad = 0;
+}
+
+void channel_free(struct channel *c)
+{
+  free(c->departs);
+  c->departs = NULL;
+  c->cap = 0;
+  channel_reset(c);
+}
+
+void channel_io(struct ckpt *ck, struct channel *c)
+{
+  int i, n;
+
+  CKPT_IO(ck, c->busy);
+  CKPT_IO(ck, c->bad);
+  n = ckpt_count(ck, c->count, INT_MAX);
+  if (ck->reading && n > c->cap) {
+    free(c->departs);
+    c->departs = malloc(n * sizeof(double));
+    if (c->departs == NULL) {
+      printf("memory allocation for the link buffer failed.");
+      exit(EXIT_FAILURE);
+    }
+    c->cap = n;
+  }
+  if (ck->reading) {
+    c->first = 0;
+    c->count = n;
+  }
+  for (i = 0; i < n; i++)
+    CKPT_IO(ck, c->departs[(c->first + i) % c->cap]);
+}
+
+int channel_room(struct channel *c, double now, int size)
+{
+  /* packets sent by now have left the buffer */
+  while (c->count > 0 && c->departs[c->first] <= now) {
+    if (++c->first == c->cap)
+      c->first = 0;
+    c->count--;
+  }
+  return size == 0 || c->count < size;
+}
+
+double channel_send(struct channel *c, double now, int bytes, double bandwidth, int size)
+{
+  double *grown;
+  int i, n;
+
+  if (c->busy < now)
+    c->busy = now;
+  if (bandwidth > 0)
+    c->busy += bytes / bandwidth;
+  if (size > 0) {
+    if (c->count == c->cap) {       /* only a replay overfills the buffer */
+      n = c->cap ? 2 * c->cap : size;
+      grown = malloc(n * sizeof(double));
+      if (grown == NULL) {
+        printf("memory allocation for the link buffer failed.");
+        exit(EXIT_FAILURE);
+      }
+      for (i = 0; i < c->count; i++)
+        grown[i] = c->departs[(c->first + i) % c->cap];
+      free(c->departs);
+      c->departs = grown;
+      c->cap = n;
+      c->first = 0;
+    }
+    c->departs[(c->first + c->count++) % c->cap] = c->busy;
+  }
+  return c->busy;
+}
+
+int channel_step(struct channel *c, double u, double goodbad, double badgood)
+{
+  if (c->bad)
+    c->bad = !(u < badgood);
+  else
+    c->bad = u < goodbad;
+  return c->bad;
+}
+
+/* the part of a delay above 1, with mean extra, from u in [0,1) */
+static double uniform_delay(double extra, double u)
+{
+  return 2 * extra * u;
+}
+
+static double constant_delay(double extra, double u)
+{
+  (void)u;
+  return extra;
+}
+
+static double exponential_delay(double extra, double u)
+{
+  return -extra * log(1 - u);
+}
+
+/* Pareto of the second kind (Lomax), heavy tailed */
+static double pareto_delay(double extra, double u)
+{
+  return extra * (PARETO_SHAPE - 1) * (pow(1 - u, -1 / PARETO_SHAPE) - 1);
+}
+
+/* in SIM_DELAY_ order */
+static double (*const delays[])(double, double) = {
+  uniform_delay, constant_delay, exponential_delay, pareto_delay
+};
+
+double channel_delay(int kind, double mean, double u)
+{
+  if (u >= 1.0)               /* rand() can give 1 */
+    u = 1.0 - 1.0 / 9007199254740992.0;
+  return 1.0 + delays[kind](mean - 1.0, u);
+}
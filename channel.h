@@ -0,0 +1,48 @@
+/* ******************************************************************
+   The link model of the medium, --channel link (see channel.c and
+   medium() in emulator.c).  Each direction is a link that sends
+   --bandwidth bytes per time unit and holds at most --buffer packets,
+   dropping any that find it full; its losses come in bursts, from a
+   Gilbert-Elliott chain; and on top of the time a packet waits for and
+   takes to be sent comes a propagation delay drawn from --delay.
+**********************************************************************/
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+/* the bytes a packet's header takes on the link: the ints of struct pkt */
+#define CHANNEL_HEADER 24
+
+struct ckpt;
+
+/* one direction of the medium */
+struct channel {
+  double busy;              /* when it has sent all the packets it holds */
+  double *departs;          /* when each of those is sent, oldest first: a ring */
+  int cap, first, count;    /* room in departs, the oldest, how many */
+  int bad;                  /* Gilbert-Elliott: in the bad state, losing more */
+};
+
+/* make c an idle link in the good state, keeping its memory */
+extern void channel_reset(struct channel *c);
+extern void channel_free(struct channel *c);
+
+/* write the state of c to a checkpoint, or read it back into c */
+extern void channel_io(struct ckpt *ck, struct channel *c);
+
+/* whether a packet offered at now finds room in a buffer of size */
+/* packets, 0 for one without limit                               */
+extern int channel_room(struct channel *c, double now, int size);
+
+/* queue bytes on c at now, at bandwidth bytes per time unit (0: no */
+/* limit) in a buffer of size packets; returns when they are sent   */
+extern double channel_send(struct channel *c, double now, int bytes, double bandwidth, int size);
+
+/* move the chain of c on a packet by u in [0,1]: good turns bad with */
+/* probability goodbad, bad turns good with badgood.  Returns c->bad  */
+extern int channel_step(struct channel *c, double u, double goodbad, double badgood);
+
+/* a propagation delay of distribution kind (SIM_DELAY_...) from u in */
+/* [0,1]: never less than 1, and mean on average                     */
+extern double channel_delay(int kind, double mean, double u);
+
+#endif
@@ -0,0 +1,102 @@
+/* ******************************************************************
+   Writing and reading of checkpoint files (see checkpoint.h).
+**********************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "emulator.h"
+#include "histogram.h"
+#include "checkpoint.h"
+
+static void make_header(struct ckpt_header *h)
+{
+  memset(h, 0, sizeof(*h));
+  memcpy(h->magic, CKPT_MAGIC, sizeof(CKPT_MAGIC));
+  h->sizes[0] = sizeof(struct sim_config);
+  h->sizes[1] = sizeof(struct sim_stats);
+  h->sizes[2] = sizeof(struct pkt);
+  h->sizes[3] = sizeof(struct msg);
+  h->sizes[4] = sizeof(struct histogram);
+}
+
+static void set_path(struct ckpt *ck, const char *path)
+{
+  if (strlen(path) >= sizeof(ck->path)) {
+    printf("checkpoint file name too long: %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  strcpy(ck->path, path);
+  sprintf(ck->tmp, "%s.new", path);
+}
+
+void ckpt_create(struct ckpt *ck, const char *path)
+{
+  struct ckpt_header h;
+
+  set_path(ck, path);
+  ck->reading = 0;
+  ck->fp = fopen(ck->tmp, "wb");
+  if (ck->fp == NULL) {
+    printf("cannot write checkpoint %s\n", ck->tmp);
+    exit(EXIT_FAILURE);
+  }
+  make_header(&h);
+  CKPT_IO(ck, h);
+}
+
+void ckpt_open(struct ckpt *ck, const char *path)
+{
+  struct ckpt_header h, want;
+
+  set_path(ck, path);
+  ck->reading = 1;
+  ck->fp = fopen(path, "rb");
+  if (ck->fp == NULL) {
+    printf("cannot open checkpoint %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  make_header(&want);
+  CKPT_IO(ck, h);
+  if (memcmp(&h, &want, sizeof(h)) != 0) {
+    printf("%s is not a checkpoint of this build of the emulator\n", path);
+    exit(EXIT_FAILURE);
+  }
+}
+
+void ckpt_io(struct ckpt *ck, void *p, size_t n)
+{
+  if (n == 0)
+    return;
+  if (ck->reading && fread(p, n, 1, ck->fp) != 1) {
+    printf("checkpoint %s is cut short\n", ck->path);
+    exit(EXIT_FAILURE);
+  }
+  if (!ck->reading && fwrite(p, n, 1, ck->fp) != 1) {
+    printf("cannot write checkpoint %s\n", ck->tmp);
+    exit(EXIT_FAILURE);
+  }
+}
+
+int ckpt_count(struct ckpt *ck, int n, int most)
+{
+  CKPT_IO(ck, n);
+  if (n < 0 || n > most) {
+    printf("checkpoint %s is damaged\n", ck->path);
+    exit(EXIT_FAILURE);
+  }
+  return n;
+}
+
+void ckpt_close(struct ckpt *ck)
+{
+  if (ck->reading) {
+    fclose(ck->fp);
+    ck->fp = NULL;
+    return;
+  }
+  if (fclose(ck->fp) != 0 || rename(ck->tmp, ck->path) != 0) {
+    printf("cannot write checkpoint %s\n", ck->path);
+    exit(EXIT_FAILURE);
+  }
+  ck->fp = NULL;
+}
@@ -0,0 +1,54 @@
+/* ******************************************************************
+   Checkpoints of a simulation run.
+
+   With --checkpoint file the emulator writes, every --interval of
+   simulated time, all a run needs to carry on from there: the clock,
+   the random number streams, the statistics, the medium, the pending
+   events and, through the checkpoint() of its struct protocol, the
+   state of the entities.  --restore file carries on from such a file
+   without simulating the time before it again.  File layout: a struct
+   ckpt_header, then the state in the order the emulator and the
+   protocol pass it to ckpt_io(), native byte order; a checkpoint is
+   only read back by a build with the same sizes and protocol options.
+**********************************************************************/
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdio.h>
+#include "emulator.h"
+
+struct ckpt_header {
+  char magic[8];                /* CKPT_MAGIC */
+  unsigned int sizes[5];        /* of the config, statistics, packets, messages */
+                                /* and histograms of the build that wrote it    */
+};
+
+#define CKPT_MAGIC "SIMCKP1"
+
+/* a checkpoint being written or read.  The same code does both: */
+/* ckpt_io() copies each item to the file, or from it            */
+struct ckpt {
+  FILE *fp;
+  int reading;
+  char path[SIM_PATHMAX];
+  char tmp[SIM_PATHMAX + 4];    /* written first, then renamed to path */
+};
+
+/* start writing a checkpoint to path / reading one back from it; */
+/* both exit if they can't, or if the file is of another build     */
+extern void ckpt_create(struct ckpt *ck, const char *path);
+extern void ckpt_open(struct ckpt *ck, const char *path);
+
+/* write the n bytes at p, or read them back into p */
+extern void ckpt_io(struct ckpt *ck, void *p, size_t n);
+#define CKPT_IO(ck, x)  ckpt_io((ck), &(x), sizeof(x))
+
+/* write the count n, or read one back and check it is from 0 to most; */
+/* the count either way                                                 */
+extern int ckpt_count(struct ckpt *ck, int n, int most);
+
+/* finish: a checkpoint written replaces any earlier one at its path */
+/* only now, so a run stopped while writing leaves that one intact   */
+extern void ckpt_close(struct ckpt *ck);
+
+#endif
@@ -0,0 +1,22 @@
+/* ******************************************************************
+   Packet checksum shared by the protocol entities (see checksum.c).
+**********************************************************************/
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include "emulator.h"
+
+#define CHECKSUM_HEADER 16    /* seqnum, acknum, length and more; then the payload */
+
+/* checksum of packet, not counting its checksum field */
+extern int pkt_checksum(const struct pkt *packet);
+
+/* the same value without the crc32 instruction, whatever the build */
+extern int pkt_checksum_table(const struct pkt *packet);
+
+/* true if the checksum field of packet doesn't match its contents; a */
+/* damaged length is caught before the checksum reads past the payload */
+#define pkt_corrupted(packet) ((packet)->length < 0 || (packet)->length > MAXPAYLOAD || \
+                               (packet)->checksum != pkt_checksum(packet))
+
+#endif
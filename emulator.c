@@ -33,175 +33,769 @@
    soon as n packets are sent.
    - fixed C style to adhere to current programming style
 
+   Modifications:
+   - the sorted event list is replaced by a heap (see evqueue.c), so
+   scheduling an event is O(log n) rather than a walk of the list.
+   - events, and the packet copy carried by an arrival, come from a
+   recycling pool owned by the event queue instead of malloc/free.
+   - numbered timers (starttimer_id/stoptimer_id) let an entity run one
+   timer per packet; the id is passed back to its interrupt handler.
+   - all run parameters, plus the random seed and the protocol window
+   and sequence space, can be given as --flags or in a --config file
+   (see usage()); only the missing ones are prompted for.
+   - sim_setting()/sim_run() run a simulation from another program;
+   compile with -DEMULATOR_NO_MAIN to leave out main().
+   - all state lives in a struct simulation that every routine is
+   passed, so simulations are reentrant and can run in parallel.  Each
+   simulation has its own random number generator; with --rng rand it
+   is a copy of the C library's additive feedback generator and
+   reproduces the old rand() sequence, by default xoshiro256** (below).
+   - random numbers now come from xoshiro256** (see rng.h), with a
+   separate stream for arrivals, loss, delay and corruption; --rng rand
+   brings back the rand() sequence for reproducing older runs.
+   - trace output goes through TRACE_EVENT() and the message table of
+   tracemsgs.h (see trace.h): compiled out with -DTRACE_MODE=TRACE_OFF,
+   or stored unformatted in a ring of records, written to --tracefile
+   and decoded later by tracedump, with -DTRACE_MODE=TRACE_BINARY.
+   - --eventlog writes a binary log of every event and channel decision
+   (see evlog.h); --replay takes arrivals and channel decisions from
+   such a log instead of the random numbers.
+   - --queue N lets the sender hold up to N messages while its window is
+   full (see sendq.h) rather than drop them.
+   - the protocol is called through the struct protocol (see protocol.h)
+   that --protocol chooses, so one binary holds both GBN and SR.
+   - the report adds goodput, delivery latency percentiles (from the
+   time each message is handed to layer 4 to its delivery, in a fixed
+   size histogram, see histogram.h), resends per delivered message and
+   the packets in the medium on average; --json writes it all as JSON.
+   - a packet is built once, in a pooled buffer from pkt_alloc(), and
+   tolayer3_pkt() sends it through the medium and on to the receiving
+   entity's input routine by reference; tolayer3() is a wrapper that
+   copies a by-value packet into such a buffer.
+   - packets carry a payload length, and a flag for messages split
+   over several of them; --mtu caps the payload and --msgsize sets
+   the size of the messages from layer 5, up to the MAXPAYLOAD and
+   MAXMSG the emulator is built with.  The report adds throughput.
+   - tolayer5_batch() hands a run of in-order messages to layer 5 at
+   once; the report shows how many a hand-over carried.
+   - --flows N runs N connections, each with entities, timers and
+   statistics of its own, over the one medium; packets carry their
+   connection in conn.  The report adds a line per connection.
+   --threads T deals the connections out to T shards run in parallel,
+   which meet every LOOKAHEAD of simulated time to pass the packets
+   sent through the shared medium (see shards()).
+   - --channel link replaces the classic medium with links of a given
+   bandwidth and buffer, Gilbert-Elliott bursts of loss and a choice
+   of propagation delay distributions (see channel.h).  The classic
+   medium remains the default.
+   - --checkpoint file writes the state of the run to file every
+   --interval of simulated time, and --restore file carries a run on
+   from there, exactly as it would have gone on (see checkpoint.h).
+   Build with: gcc -pthread -o sr emulator.c evqueue.c trace.c evlog.c rng.c checksum.c sendq.c histogram.c bitmap.c channel.c checkpoint.c gbn.c sr.c -lm
+
    ********************************************************************* */
 #include <stdlib.h>
 #include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <limits.h>
 #include "emulator.h"
 #include "gbn.h"
+#include "sr.h"
+#include "evqueue.h"
+#include "trace.h"
+#include "evlog.h"
+#include "rng.h"
+#include "histogram.h"
+#include "channel.h"
+#include "checkpoint.h"
 
-struct event {
-  float evtime;           /* event time */
-  int evtype;             /* event type code */
-  int eventity;           /* entity where event occurs */
-  struct pkt *pktptr;     /* ptr to packet (if any) assoc w/ this event */
-  struct event *prev;
-  struct event *next;
-};
-
-struct event *evlist = NULL;   /* the event list */
+/* -DSIM_THREADS=0 builds without pthreads; --threads is then ignored */
+#ifndef SIM_THREADS
+#define SIM_THREADS 1
+#endif
+#if SIM_THREADS
+#include <pthread.h>
+#endif
 
 /* possible events: */
 #define  TIMER_INTERRUPT 0  
 #define  FROM_LAYER5     1
 #define  FROM_LAYER3     2
 
+#define  NOTIMERID      (-1)    /* evtimerid of the starttimer() timer */
+
 #define  OFF             0
 #define  ON              1
 
-int TRACE = 3;
-
-/* statistics updated by GBN */
-int window_full;   /* count of the number of messages dropped due to full window */
-int total_ACKs_received;
-int packets_resent;       /* count of the number of packets resent  */
-int new_ACKs;           /* count of the number of acks correctly received */
-int packets_received;  /* count of the packets received by receiver */
-
-/* statistics updated by emulator */
-static int packets_lost;  
-static int packets_corrupt;
-static int packets_sent;
-static int packets_timeout;
-static int messages_delivered;
-
-static int nsim = 0;              /* number of messages from 5 to 4 so far */ 
-static int nsimmax = 0;           /* number of msgs to generate, then stop */
-static float time = 0.000;
-static float lossprob;            /* probability that a packet is dropped  */
-static float corruptprob;   /* probability that one bit is packet is flipped */
-static int corruptdirection; /* A->B A<-B or bidirectional corruption/loss */
-static float lambda;        /* arrival rate of messages from layer 5 */   
-static int   ntolayer3;           /* number sent into layer 3 */
-static int   nlost;               /* number lost in media */
-static int ncorrupt;              /* number corrupted by media*/
+#define  NSETTINGS      31
+
+#define  TRACERING    4096      /* records buffered before a binary trace is written */
+
+/* when each message on its way from one entity was handed to layer 4, */
+/* oldest first: the protocols deliver in order, so tolayer5() matches */
+/* every delivery with the oldest                                      */
+struct handoffs {
+  float *time;
+  int size, first, count;
+};
+
+/* one of the --flows connections between A and B.  Each has protocol */
+/* entities, timers and statistics of its own; they share the medium   */
+struct connection {
+  struct sim_stats stats;       /* its part of the statistics */
+  struct event *timers[2];      /* pending timer event of A and B, if any */
+  struct event **idtimers[2];   /* pending event of each numbered timer */
+  int nidtimers[2];             /* slots allocated in idtimers[A] and [B] */
+  struct handoffs handoff[2];   /* messages from A and B not yet delivered */
+  struct histogram latency;     /* delivery latencies */
+  double inflight_area;         /* time its packets spent in the medium */
+  int id;                       /* its number, 0 to flows - 1, in the packets' conn */
+
+  void *protocol;               /* state of the protocol entities */
+  void (*release_protocol)(void *);
+};
+
+struct simulation {
+  struct sim_config cfg;
+  int given[NSETTINGS];         /* which settings have been supplied */
+  struct sim_stats stats;       /* the totals of all connections */
+  struct sim_stats *current;    /* what sim_stats() gives: the running connection's */
+                                /* during a run, the totals after it                */
+
+  struct connection *conns;     /* the connections of the last run */
+  int nconns;
+  struct connection *conn;      /* the one whose entities are being run */
+
+  struct evqueue evlist;        /* the future event set */
+  float lastarrival[2];         /* latest arrival scheduled at A and B */
+  unsigned long lastseq[2];     /* evseq of the latest packet to arrive at A and B: */
+                                /* arrivals are queued in the order they are sent,  */
+                                /* so a medium that keeps that order only raises it */
+  struct channel link[2];       /* the links to A and to B, of --channel link */
+  struct histogram latency;     /* delivery latencies of all connections */
+  int inflight;                 /* packets in the medium */
+  double inflight_area;         /* inflight integrated over simulated time */
+  float time;
+  int nsim;                     /* number of messages from 5 to 4 so far */ 
+  struct rng rng;               /* random numbers, a stream per kind of decision */
+
+  const struct protocol *proto; /* the protocol of the current run */
+
+  /* the simulation whose medium the packets go through: this one, or */
+  /* for a shard of a --threads run the one it is part of, which takes */
+  /* the packets the shard sent in a window all at once (see shards()) */
+  struct simulation *net;
+  struct event **outbox;        /* packets sent in this window, in order */
+  int noutbox, outboxsize;
+
+  struct evlog_writer log;      /* the event log, if log.fp != NULL */
+  struct evlog replay;          /* the log being replayed, if replay.rec != NULL */
+  long replaynext[3];           /* where to look for the next send by A, by B, arrival */
+  int replaydone[3];            /* set once the log has run out of each */
+
+#if TRACE_MODE == TRACE_BINARY
+  FILE *tracefp;                /* the binary trace being written, if any */
+  struct trace_rec *tracering;  /* records not yet written to it */
+  int ntrace;
+#endif
+};
+
+/* default settings of a new simulation */
+static const struct sim_config default_config = {
+  0, 0.0, 0.0, 0, 0.0,
+  3,                            /* trace */
+  9999,                         /* seed */
+  SIM_RNG_XOSHIRO,              /* rng */
+  SIM_PROTOCOL_SR,              /* protocol */
+  0, 0, 0,                      /* window, seqspace, queue */
+  MAXPAYLOAD, 20,               /* mtu, msgsize */
+  1, 1,                         /* flows, threads */
+  SIM_CHANNEL_CLASSIC, 0.0, 0,  /* channel, bandwidth, buffer */
+  0.0, 0.5, 1.0,                /* goodbad, badgood, badloss */
+  SIM_DELAY_UNIFORM, 5.5,       /* delay, delaymean: those of the classic medium */
+  "sim.trace",                  /* tracefile */
+  "", "",                       /* eventlog, replay */
+  "",                           /* json */
+  "", 0.0, ""                   /* checkpoint, interval, restore */
+};
 
 /****************************************************************************/
-/* jimsrand(): return a double in range [0,1].  The routine below is used to */
-/* isolate all random number generation in one location.  We assume that the*/
-/* system-supplied rand() function return an int in therange [0,mmm]        */
+/* jimsrand(): return a double in range [0,1] from one of the streams of    */
+/* rng.h.  The routine below is used to isolate all random number           */
+/* generation in one location.                                              */
 /****************************************************************************/
-double jimsrand(void) 
+static double jimsrand(struct simulation *sim, int stream) 
 {
-  double mmm = RAND_MAX;     /* largest int  - MACHINE DEPENDENT!!!!!!!!   */
   double x;                   
-  x = rand()/mmm;            /* x should be uniform in [0,1] */
-  if (TRACE > 3)
-    printf("RANDOM NUMBER GENERAION CALLED: %f\n", x);
+  x = rng_uniform(&sim->rng, stream); /* x should be uniform in [0,1] */
+  TRACE_EVENT(sim, RAND, x);
   return(x);
 }  
 
-/********************* EVENT HANDLINE ROUTINES *******/
-/*  The next set of routines handle the event list   */
-/*****************************************************/
+/* the xoshiro streams each advance once per packet, whatever happens   */
+/* to it, so changing one probability leaves the other decisions alone; */
+/* rand() is drawn only as needed, as it always has been                 */
+#define INSTEP(sim) ((sim)->rng.kind != RNG_RAND)
+
+/********************* TRACING *****************************/
+/*  sim_trace() is what TRACE_EVENT() calls once the trace */
+/*  level of the message is reached                         */
+/***********************************************************/
 
-void insertevent(struct event *p)
+#if TRACE_MODE == TRACE_TEXT
+void sim_trace(struct simulation *sim, int msg, ...)
 {
-  struct event *q,*qold;
+  struct trace_rec rec;
+  va_list ap;
 
-  if (TRACE>2) {
-    printf("            INSERTEVENT: time is %f\n",time);
-    printf("            INSERTEVENT: future time will be %f\n",p->evtime); 
-  }
-  q = evlist;     /* q points to front of list in which p struct inserted */
-  if (q==NULL) {   /* list is empty */
-    evlist=p;
-    p->next=NULL;
-    p->prev=NULL;
+  (void)sim;
+  va_start(ap, msg);
+  trace_pack(&rec, msg, ap);
+  va_end(ap);
+  trace_print(stdout, &rec);
+}
+#elif TRACE_MODE == TRACE_BINARY
+/* write the buffered records of sim out to its trace file */
+static void flushtrace(struct simulation *sim)
+{
+  if (sim->ntrace > 0 &&
+      fwrite(sim->tracering, sizeof(struct trace_rec), sim->ntrace, sim->tracefp) != (size_t)sim->ntrace) {
+    printf("cannot write trace file %s\n", sim->cfg.tracefile);
+    exit(EXIT_FAILURE);
   }
-  else {
-    for (qold = q; q !=NULL && p->evtime > q->evtime; q=q->next)
-      qold=q; 
-    if (q==NULL) {   /* end of list */
-      qold->next = p;
-      p->prev = qold;
-      p->next = NULL;
-    }
-    else if (q==evlist) { /* front of list */
-      p->next=evlist;
-      p->prev=NULL;
-      p->next->prev=p;
-      evlist = p;
+  sim->ntrace = 0;
+}
+
+void sim_trace(struct simulation *sim, int msg, ...)
+{
+  struct trace_header h;
+  va_list ap;
+
+  if (sim->tracefp == NULL) {
+    sim->tracefp = fopen(sim->cfg.tracefile, "wb");
+    if (sim->tracering == NULL)
+      sim->tracering = malloc(TRACERING * sizeof(struct trace_rec));
+    if (sim->tracefp == NULL || sim->tracering == NULL) {
+      printf("cannot open trace file %s\n", sim->cfg.tracefile);
+      exit(EXIT_FAILURE);
     }
-    else {     /* middle of list */
-      p->next=q;
-      p->prev=q->prev;
-      q->prev->next=p;
-      q->prev=p;
+    trace_make_header(&h);
+    fwrite(&h, sizeof(h), 1, sim->tracefp);
+  }
+  else if (sim->ntrace == TRACERING)
+    flushtrace(sim);
+  va_start(ap, msg);
+  trace_pack(&sim->tracering[sim->ntrace++], msg, ap);
+  va_end(ap);
+}
+#endif
+
+/* finish the trace of a run, if it is being written to a file */
+static void endtrace(struct simulation *sim)
+{
+#if TRACE_MODE == TRACE_BINARY
+  if (sim->tracefp != NULL) {
+    flushtrace(sim);
+    fclose(sim->tracefp);
+    sim->tracefp = NULL;
+  }
+#else
+  (void)sim;
+#endif
+}
+
+/********************* EVENT LOG AND REPLAY ***************/
+/*  The log, and the replay of one, are set up by         */
+/*  startlog() and torn down by endlog() around each run  */
+/**********************************************************/
+
+/* append a record of the given kind, at the current time, to the log */
+static void logrec(struct simulation *sim, int kind, int entity, const struct pkt *p,
+                   int fate, int timerid, double delaydraw)
+{
+  struct evlog_rec r;
+
+  memset(&r, 0, sizeof(r));
+  r.time = sim->time;
+  r.kind = (unsigned char)kind;
+  r.entity = (unsigned char)entity;
+  r.fate = (unsigned char)fate;
+  r.timerid = timerid;
+  r.delaydraw = delaydraw;
+  r.conn = sim->conn->id;
+  if (p != NULL) {
+    r.seqnum = p->seqnum;
+    r.acknum = p->acknum;
+  }
+  evlog_put(&sim->log, &r);
+}
+
+#define LOGGING(sim) ((sim)->log.fp != NULL)
+
+/* the next record of the replayed log for a send by A or B (kind   */
+/* EVL_SEND) or for an arrival from layer 5 (EVL_LAYER5); NULL, and */
+/* the random numbers take over, once the log has no more of them   */
+static const struct evlog_rec *replayed(struct simulation *sim, int kind, int entity)
+{
+  int stream = kind == EVL_SEND ? entity : 2;
+  long i;
+
+  if (sim->replay.rec == NULL || sim->replaydone[stream])
+    return NULL;
+  for (i = sim->replaynext[stream]; i < sim->replay.n; i++)
+    if (sim->replay.rec[i].kind == kind && (kind != EVL_SEND || sim->replay.rec[i].entity == entity)) {
+      sim->replaynext[stream] = i + 1;
+      return &sim->replay.rec[i];
     }
+  printf("Warning: replayed event log has no more %s; drawing them at random\n",
+         kind == EVL_SEND ? (entity == A ? "packets sent by A" : "packets sent by B") : "arrivals");
+  sim->replaydone[stream] = 1;
+  return NULL;
+}
+
+static void startlog(struct simulation *sim)
+{
+  int i;
+
+  if (sim->cfg.replay[0] != '\0' && !evlog_load(&sim->replay, sim->cfg.replay)) {
+    printf("cannot read event log %s\n", sim->cfg.replay);
+    exit(EXIT_FAILURE);
+  }
+  for (i = 0; i < 3; i++) {
+    sim->replaynext[i] = 0;
+    sim->replaydone[i] = 0;
+  }
+  if (sim->cfg.eventlog[0] != '\0' && !evlog_open(&sim->log, sim->cfg.eventlog)) {
+    printf("cannot create event log %s\n", sim->cfg.eventlog);
+    exit(EXIT_FAILURE);
   }
 }
 
-void generate_next_arrival(void)
+static void endlog(struct simulation *sim)
+{
+  if (LOGGING(sim))
+    evlog_close(&sim->log);
+  evlog_free(&sim->replay);
+}
+
+/********************* EVENT HANDLINE ROUTINES *******/
+/*  The next set of routines handle the event list   */
+/*****************************************************/
+
+void insertevent(struct simulation *sim, struct event *p)
+{
+  TRACE_EVENT(sim, INSERTEVENT, sim->time, p->evtime);
+  evq_push(&sim->evlist, p);
+}
+
+void generate_next_arrival(struct simulation *sim)
 {
   double x;
   struct event *evptr;
+  const struct evlog_rec *r;
 
-  if (TRACE>2)
-    printf("          GENERATE NEXT ARRIVAL: creating new arrival\n");
+  TRACE_EVENT(sim, NEXT_ARRIVAL);
+
+  evptr = evq_alloc(&sim->evlist);
+  evptr->evtype =  FROM_LAYER5;
+  if ((r = replayed(sim, EVL_LAYER5, A)) != NULL) {
+    if (r->conn >= sim->nconns) {
+      printf("the replayed event log has connection %d; run it with --flows %d or more\n",
+             r->conn, r->conn + 1);
+      exit(EXIT_FAILURE);
+    }
+    evptr->evtime = r->time;
+    evptr->eventity = r->entity;
+    evptr->evconn = r->conn;
+    insertevent(sim, evptr);
+    return;
+  }
  
-  x = lambda*jimsrand()*2;  /* x is uniform on [0,2*lambda] */
+  x = sim->cfg.lambda*jimsrand(sim, RNG_ARRIVAL)*2;  /* x is uniform on [0,2*lambda] */
   /* having mean of lambda        */
-  evptr = malloc(sizeof(struct event));
-  if (evptr == 0) {
-    printf("memory allocation for event failed.");
-    exit(EXIT_FAILURE);
-  }
-  evptr->evtime =  time + x;
-  evptr->evtype =  FROM_LAYER5;
-  if (BIDIRECTIONAL && (jimsrand()>0.5) )
+  evptr->evtime =  sim->time + x;
+  if (sim->proto->bidirectional && (jimsrand(sim, RNG_ARRIVAL)>0.5) )
     evptr->eventity = B;
   else
     evptr->eventity = A;
-  insertevent(evptr);
+  /* the message is for any of the connections alike; with one, no */
+  /* number is drawn, so the stream is that of a single connection */
+  evptr->evconn = 0;
+  if (sim->nconns > 1) {
+    evptr->evconn = (int)(jimsrand(sim, RNG_ARRIVAL) * sim->nconns);
+    if (evptr->evconn == sim->nconns)
+      evptr->evconn--;
+  }
+  insertevent(sim, evptr);
 } 
 
-void printevlist(void)
+void printevlist(struct simulation *sim)
 {
   struct event *q;
-  printf("--------------\nEvent List Follows:\n");
-  for(q = evlist; q!=NULL; q=q->next) {
+  int i;
+  printf("--------------\nEvent List Follows (heap order):\n");
+  for (i = 0; i < sim->evlist.size; i++) {
+    q = sim->evlist.heap[i];
     printf("Event time: %f, type: %d entity: %d\n",q->evtime,q->evtype,q->eventity);
   }
   printf("--------------\n");
 }
 
-void init(void)                         /* initialize the simulator */
+/********************* RUN PARAMETERS *******************/
+/*  Every parameter can be given on the command line as */
+/*  --name value (or --name=value), or as a name=value  */
+/*  line of a file read with --config.  Anything not    */
+/*  given is asked for interactively, as before.        */
+/********************************************************/
+
+struct setting {
+  const char *name;       /* command line flag and config file key */
+  char type;              /* 'i' int, 'u' unsigned, 'f' float, 's' file name, */
+                          /* 'k' keyword: the int is its index in names */
+  size_t offset;          /* where the value lives in struct sim_config */
+  const char *help;
+  const char *const *names;
+};
+
+static const char *const rng_names[] = { "xoshiro", "rand", NULL };
+
+/* the protocols a run can use, in SIM_PROTOCOL_ order */
+static const struct protocol *const protocols[] = { &sr_protocol, &gbn_protocol };
+static const char *const protocol_names[] = { "sr", "gbn", NULL };
+static const char *const channel_names[] = { "classic", "link", NULL };
+static const char *const delay_names[] = { "uniform", "constant", "exponential", "pareto", NULL };
+
+static const struct setting settings[NSETTINGS] = {
+  { "msgs",      'i', offsetof(struct sim_config, nsimmax),          "number of messages to simulate", NULL },
+  { "loss",      'f', offsetof(struct sim_config, lossprob),         "packet loss probability", NULL },
+  { "corrupt",   'f', offsetof(struct sim_config, corruptprob),      "packet corruption probability", NULL },
+  { "direction", 'i', offsetof(struct sim_config, corruptdirection), "loss/corruption direction: 0 A->B, 1 A<-B, 2 both", NULL },
+  { "lambda",    'f', offsetof(struct sim_config, lambda),           "average time between messages from layer5", NULL },
+  { "trace",     'i', offsetof(struct sim_config, trace),            "trace level", NULL },
+  { "seed",      'u', offsetof(struct sim_config, seed),             "random number generator seed (default 9999)", NULL },
+  { "rng",       'k', offsetof(struct sim_config, rng),              "random numbers: xoshiro (default) or rand, as of old",
+    rng_names },
+  { "protocol",  'k', offsetof(struct sim_config, protocol),         "sr (Selective Repeat, the default) or gbn (Go-Back-N)",
+    protocol_names },
+  { "window",    'i', offsetof(struct sim_config, windowsize),       "protocol window size", NULL },
+  { "seqspace",  'i', offsetof(struct sim_config, seqspace),         "protocol sequence space", NULL },
+  { "queue",     'i', offsetof(struct sim_config, queuesize),        "messages queued while the window is full (default 0: dropped)", NULL },
+  { "mtu",       'i', offsetof(struct sim_config, mtu),              "largest packet payload in bytes (default and most: MAXPAYLOAD)", NULL },
+  { "msgsize",   'i', offsetof(struct sim_config, msgsize),          "bytes in each message from layer5 (default 20, most: MAXMSG)", NULL },
+  { "flows",     'i', offsetof(struct sim_config, flows),            "connections between A and B sharing the medium (default 1)", NULL },
+  { "threads",   'i', offsetof(struct sim_config, threads),          "worker threads for a run of several connections (default 1)", NULL },
+  { "channel",   'k', offsetof(struct sim_config, channel),          "medium: classic (the default) or link, which has the settings below",
+    channel_names },
+  { "bandwidth", 'f', offsetof(struct sim_config, bandwidth),        "link: bytes sent per time unit (default 0: no limit)", NULL },
+  { "buffer",    'i', offsetof(struct sim_config, buffer),           "link: packets it holds, the rest are dropped (default 0: no limit)", NULL },
+  { "goodbad",   'f', offsetof(struct sim_config, goodbad),          "link: chance per packet of a burst of loss starting (default 0)", NULL },
+  { "badgood",   'f', offsetof(struct sim_config, badgood),          "link: ... and of one ending (default 0.5)", NULL },
+  { "badloss",   'f', offsetof(struct sim_config, badloss),          "link: loss probability during a burst (default 1)", NULL },
+  { "delay",     'k', offsetof(struct sim_config, delay),            "link: propagation delay: uniform (default), constant, exponential or pareto",
+    delay_names },
+  { "delaymean", 'f', offsetof(struct sim_config, delaymean),        "link: mean propagation delay, at least 1 (default 5.5)", NULL },
+  { "tracefile", 's', offsetof(struct sim_config, tracefile),        "file a binary trace build writes to", NULL },
+  { "eventlog",  's', offsetof(struct sim_config, eventlog),         "file to write a binary event log to", NULL },
+  { "replay",    's', offsetof(struct sim_config, replay),           "event log to take arrivals and losses from", NULL },
+  { "json",      's', offsetof(struct sim_config, json),             "file to write the statistics to as JSON, - for stdout", NULL },
+  { "checkpoint",'s', offsetof(struct sim_config, checkpoint),       "file to write the state of the run to every --interval", NULL },
+  { "interval",  'f', offsetof(struct sim_config, interval),         "simulated time between checkpoints", NULL },
+  { "restore",   's', offsetof(struct sim_config, restore),          "checkpoint to carry a run on from", NULL },
+};
+
+/* index of setting name in settings[], -1 if there is none */
+static int find_setting(const char *name)
 {
-  float sum, avg;
   int i;
 
-  printf("-----  Stop and Wait Network Simulator Version 1.1 -------- \n\n");
-  printf("Enter the number of messages to simulate: ");
-  scanf("%d",&nsimmax);
-  printf("Enter  packet loss probability [enter 0.0 for no loss]:");
-  scanf("%f",&lossprob);
-  printf("Enter packet corruption probability [0.0 for no corruption]:");
-  scanf("%f",&corruptprob);
-  if (lossprob != 0.0 || corruptprob != 0.0) {
+  for (i = 0; i < NSETTINGS; i++)
+    if (strcmp(settings[i].name, name) == 0)
+      return i;
+  return -1;
+}
+
+#define GIVEN(sim, name) ((sim)->given[find_setting(name)])
+
+int sim_setting(struct simulation *sim, const char *name, const char *text)
+{
+  int i = find_setting(name);
+  void *value;
+  char *end;
+  long l;
+  double d;
+
+  /* an empty file name clears the setting; nothing else may be empty */
+  if (i < 0 || (*text == '\0' && settings[i].type != 's'))
+    return 0;
+  value = (char *)&sim->cfg + settings[i].offset;
+  if (settings[i].type == 's') {
+    if (strlen(text) >= SIM_PATHMAX)
+      return 0;
+    strcpy(value, text);
+  }
+  else if (settings[i].type == 'k') {
+    for (l = 0; settings[i].names[l] != NULL && strcmp(settings[i].names[l], text) != 0; l++)
+      ;
+    if (settings[i].names[l] == NULL)
+      return 0;
+    *(int *)value = (int)l;
+  }
+  else if (settings[i].type == 'f') {
+    d = strtod(text, &end);
+    if (*end != '\0')
+      return 0;
+    *(float *)value = (float)d;
+  }
+  else {
+    l = strtol(text, &end, 10);
+    if (*end != '\0' || (settings[i].type == 'u' && l < 0))
+      return 0;
+    if (settings[i].type == 'u')
+      *(unsigned int *)value = (unsigned int)l;
+    else
+      *(int *)value = (int)l;
+  }
+  sim->given[i] = 1;
+  return 1;
+}
+
+static void usage(const char *prog)
+{
+  int i;
+
+  printf("usage: %s [--config file] [--name value ...]\n", prog);
+  for (i = 0; i < NSETTINGS; i++)
+    printf("  --%-10s %s\n", settings[i].name, settings[i].help);
+  printf("parameters that are not given are asked for on stdin\n");
+}
+
+/* read name=value lines; blank lines and lines starting with # are skipped */
+static void read_config(struct simulation *sim, const char *path)
+{
+  FILE *f;
+  char line[256], *eq, *name, *value, *p;
+  int lineno = 0;
+
+  f = fopen(path, "r");
+  if (f == NULL) {
+    printf("cannot open config file %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  while (fgets(line, sizeof(line), f) != NULL) {
+    lineno++;
+    for (name = line; *name == ' ' || *name == '\t'; name++)
+      ;
+    if (*name == '#' || *name == '\n' || *name == '\r' || *name == '\0')
+      continue;
+    eq = strchr(name, '=');
+    if (eq == NULL) {
+      printf("%s:%d: expected name=value\n", path, lineno);
+      exit(EXIT_FAILURE);
+    }
+    /* trim blanks around the name and the value */
+    for (p = eq; p > name && (p[-1] == ' ' || p[-1] == '\t'); p--)
+      ;
+    *p = '\0';
+    for (value = eq + 1; *value == ' ' || *value == '\t'; value++)
+      ;
+    for (p = value + strlen(value); p > value && strchr(" \t\r\n", p[-1]); p--)
+      ;
+    *p = '\0';
+    if (!sim_setting(sim, name, value)) {
+      printf("%s:%d: bad setting %s=%s\n", path, lineno, name, value);
+      exit(EXIT_FAILURE);
+    }
+  }
+  fclose(f);
+}
+
+/* later arguments override earlier ones and the config file they follow */
+void sim_parse_args(struct simulation *sim, int argc, char **argv)
+{
+  char flag[64];
+  const char *name, *value, *eq;
+  int i;
+  size_t len;
+
+  for (i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+      usage(argv[0]);
+      exit(EXIT_SUCCESS);
+    }
+    if (strncmp(argv[i], "--", 2) != 0) {
+      usage(argv[0]);
+      exit(EXIT_FAILURE);
+    }
+    name = argv[i] + 2;
+    eq = strchr(name, '=');
+    if (eq != NULL) {
+      len = (size_t)(eq - name);
+      value = eq + 1;
+    }
+    else {
+      len = strlen(name);
+      if (i + 1 >= argc) {
+        printf("missing value for --%s\n", name);
+        exit(EXIT_FAILURE);
+      }
+      value = argv[++i];
+    }
+    if (len >= sizeof(flag))
+      len = sizeof(flag) - 1;
+    memcpy(flag, name, len);
+    flag[len] = '\0';
+    if (strcmp(flag, "config") == 0)
+      read_config(sim, value);
+    else if (!sim_setting(sim, flag, value)) {
+      printf("bad option --%s %s\n", flag, value);
+      usage(argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+/* ask for the parameters that were not given, and check them all */
+static void settle_config(struct simulation *sim)
+{
+  struct sim_config *cfg = &sim->cfg;
+
+  if (!GIVEN(sim, "msgs")) {
+    printf("Enter the number of messages to simulate: ");
+    scanf("%d",&cfg->nsimmax);
+  }
+  if (!GIVEN(sim, "loss")) {
+    printf("Enter  packet loss probability [enter 0.0 for no loss]:");
+    scanf("%f",&cfg->lossprob);
+  }
+  if (!GIVEN(sim, "corrupt")) {
+    printf("Enter packet corruption probability [0.0 for no corruption]:");
+    scanf("%f",&cfg->corruptprob);
+  }
+  if ((cfg->lossprob != 0.0 || cfg->corruptprob != 0.0) && !GIVEN(sim, "direction")) {
     printf("If you want loss or corruption to only occur in one direction, choose the direction: 0 A->B, 1 A<-B, 2 A<->B (both directions) :");
-    scanf("%d",&corruptdirection);
+    scanf("%d",&cfg->corruptdirection);
+  }
+  if (!GIVEN(sim, "lambda")) {
+    printf("Enter average time between messages from sender's layer5 [ > 0.0]:");
+    scanf("%f",&cfg->lambda);
+  }
+  if (!GIVEN(sim, "trace")) {
+    printf("Enter TRACE:");
+    scanf("%d",&cfg->trace);
+  }
+  if (cfg->mtu < 1 || cfg->mtu > MAXPAYLOAD) {
+    printf("the MTU must be from 1 to %d bytes (MAXPAYLOAD), not %d\n", MAXPAYLOAD, cfg->mtu);
+    exit(EXIT_FAILURE);
+  }
+  if (cfg->msgsize < 1 || cfg->msgsize > MAXMSG) {
+    printf("messages must be from 1 to %d bytes (MAXMSG), not %d\n", MAXMSG, cfg->msgsize);
+    exit(EXIT_FAILURE);
+  }
+  if (cfg->flows < 1 || cfg->threads < 1) {
+    printf("a run needs at least one connection and one thread, not %d and %d\n",
+           cfg->flows, cfg->threads);
+    exit(EXIT_FAILURE);
+  }
+  if (cfg->bandwidth < 0.0 || cfg->buffer < 0 || cfg->delaymean < 1.0) {
+    printf("the link needs a bandwidth and buffer of 0 or more and a mean delay of 1 or more\n");
+    exit(EXIT_FAILURE);
+  }
+  if (cfg->goodbad < 0.0 || cfg->goodbad > 1.0 || cfg->badgood < 0.0 || cfg->badgood > 1.0 ||
+      cfg->badloss < 0.0 || cfg->badloss > 1.0) {
+    printf("--goodbad, --badgood and --badloss are probabilities, from 0 to 1\n");
+    exit(EXIT_FAILURE);
+  }
+  if ((cfg->checkpoint[0] != '\0' || cfg->restore[0] != '\0') &&
+      ((cfg->threads > 1 && cfg->flows > 1) || cfg->eventlog[0] != '\0' || cfg->replay[0] != '\0')) {
+    printf("--checkpoint and --restore need a run on one thread, without --eventlog or --replay\n");
+    exit(EXIT_FAILURE);
+  }
+  if (cfg->checkpoint[0] != '\0' && cfg->interval <= 0.0) {
+    printf("--checkpoint needs an --interval of more than 0 between checkpoints\n");
+    exit(EXIT_FAILURE);
   }
-  printf("Enter average time between messages from sender's layer5 [ > 0.0]:");
-  scanf("%f",&lambda);
-  printf("Enter TRACE:");
-  scanf("%d",&TRACE);
+  if (cfg->checkpoint[0] != '\0' && strcmp(cfg->checkpoint, cfg->restore) == 0) {
+    printf("--checkpoint would overwrite the checkpoint being restored, %s\n", cfg->restore);
+    exit(EXIT_FAILURE);
+  }
+  /* a restored run has all the settings of its checkpoint */
+  if (cfg->channel == SIM_CHANNEL_CLASSIC && cfg->restore[0] == '\0' &&
+      (GIVEN(sim, "bandwidth") || GIVEN(sim, "buffer") || GIVEN(sim, "goodbad") || GIVEN(sim, "badgood") ||
+       GIVEN(sim, "badloss") || GIVEN(sim, "delay") || GIVEN(sim, "delaymean")))
+    printf("Warning: the link settings only apply with --channel link\n");
+}
+
+/* free the connections of the last run, and the state of their entities */
+static void free_connections(struct simulation *sim)
+{
+  struct connection *c;
+  int i;
 
+  for (i = 0; i < sim->nconns; i++) {
+    c = &sim->conns[i];
+    if (c->protocol != NULL && c->release_protocol != NULL)
+      c->release_protocol(c->protocol);
+    free(c->idtimers[A]);
+    free(c->idtimers[B]);
+    free(c->handoff[A].time);
+    free(c->handoff[B].time);
+  }
+  free(sim->conns);
+  sim->conns = NULL;
+  sim->nconns = 0;
+  sim->conn = NULL;
+  sim->current = &sim->stats;
+}
 
-  srand(9999);              /* init random number generator */
-  sum = 0.0;                /* test random number generator for students */
-  for (i=0; i<1000; i++)
-    sum+=jimsrand();    /* jimsrand() should be uniform in [0,1] */
-  avg = sum/1000.0;
+static void new_connections(struct simulation *sim, int n)
+{
+  int i;
+
+  free_connections(sim);
+  sim->conns = calloc(n, sizeof(struct connection));
+  if (sim->conns == NULL) {
+    printf("memory allocation for connections failed.");
+    exit(EXIT_FAILURE);
+  }
+  for (i = 0; i < n; i++) {
+    hist_init(&sim->conns[i].latency);
+    sim->conns[i].id = i;
+  }
+  sim->nconns = n;
+  sim->conn = &sim->conns[0];
+  sim->current = &sim->conn->stats;
+}
+
+/* make c the connection whose entities are run, and whose statistics */
+/* sim_stats() gives                                                  */
+static void use_connection(struct simulation *sim, struct connection *c)
+{
+  if (sim->nconns > 1)
+    TRACE_EVENT(sim, CONNECTION, c->id);
+  sim->conn = c;
+  sim->current = &c->stats;
+}
+
+/* start the random numbers, statistics, clock and medium of a run */
+static void reset(struct simulation *sim)
+{
+  struct sim_config *cfg = &sim->cfg;
+  float sum, avg;
+  int i;
+
+  /* init random number generator */
+  rng_seed(&sim->rng, cfg->rng == SIM_RNG_RAND ? RNG_RAND : RNG_XOSHIRO, cfg->seed);
+  if (cfg->rng == SIM_RNG_RAND) {
+    sum = 0.0;                /* test random number generator for students */
+    for (i=0; i<1000; i++)
+      sum+=jimsrand(sim, 0);  /* jimsrand() should be uniform in [0,1] */
+    avg = sum/1000.0;
+  }
+  else
+    avg = 0.5;                /* xoshiro is the same everywhere */
   if (avg < 0.25 || avg > 0.75) {
     printf("It is likely that random number generation on your machine\n" ); 
     printf("is different from what this emulator expects.  Please take\n");
@@ -209,273 +803,1213 @@ void init(void)                         /* initialize the simulator */
     exit(EXIT_FAILURE);
   }
 
-  /* initialise statistics */
-  window_full = 0;
-  total_ACKs_received = 0;
-  packets_resent = 0;
-  new_ACKs = 0;
-  packets_received = 0;
-  packets_lost = 0;  
-  packets_corrupt = 0;
-  packets_sent = 0;
-  packets_timeout = 0;
-  messages_delivered = 0;
+  /* initialise statistics, and the timers and handoffs of each connection */
+  memset(&sim->stats, 0, sizeof(sim->stats));
+  hist_init(&sim->latency);
+  new_connections(sim, cfg->flows);
+  sim->nsim = 0;
 
-  ntolayer3 = 0;
-  nlost = 0;
-  ncorrupt = 0;
+  sim->time=0.0;               /* initialize time to 0.0 */
+  evq_init(&sim->evlist);
+  sim->lastarrival[A] = 0.0;
+  sim->lastarrival[B] = 0.0;
+  sim->lastseq[A] = 0;
+  sim->lastseq[B] = 0;
+  channel_reset(&sim->link[A]);
+  channel_reset(&sim->link[B]);
+  sim->inflight = 0;
+  sim->inflight_area = 0.0;
+  sim->noutbox = 0;
+}
 
-  time=0.0;                    /* initialize time to 0.0 */
-  generate_next_arrival();     /* initialize event list */
+void init(struct simulation *sim)       /* initialize the simulator */
+{
+  reset(sim);
+  generate_next_arrival(sim);  /* initialize event list */
 }
 
 /********************** Student-callable ROUTINES ***********************/
 
-/* called by students routine to cancel a previously-started timer */
-void stoptimer(int AorB)
-/* A or B is trying to stop timer */
+/* returns where the pending event of timer id at A or B is recorded.  */
+/* id NOTIMERID is the classic single timer of starttimer()/stoptimer() */
+static struct event **timerslot(struct simulation *sim, int AorB, int id)
 {
-  struct event *q;
+  struct connection *c = sim->conn;
+  struct event **grown;
+  int n, i;
 
-  if (TRACE>1)
-    printf("          STOP TIMER: stopping timer at %f\n",time);
-  /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next)  */
-  for (q=evlist; q!=NULL ; q = q->next) 
-    if ( (q->evtype==TIMER_INTERRUPT  && q->eventity==AorB) ) { 
-      /* remove this event */
-      if (q->next==NULL && q->prev==NULL)
-        evlist=NULL;         /* remove first and only event on list */
-      else if (q->next==NULL) /* end of list - there is one in front */
-        q->prev->next = NULL;
-      else if (q==evlist) { /* front of list - there must be event after */
-        q->next->prev=NULL;
-        evlist = q->next;
-      }
-      else {     /* middle of list */
-        q->next->prev = q->prev;
-        q->prev->next =  q->next;
-      }
-      free(q);
-      return;
+  if (id == NOTIMERID)
+    return &c->timers[AorB];
+  if (id >= c->nidtimers[AorB]) {
+    n = c->nidtimers[AorB] ? c->nidtimers[AorB] : 16;
+    while (n <= id)
+      n *= 2;
+    grown = realloc(c->idtimers[AorB], n * sizeof(struct event *));
+    if (grown == NULL) {
+      printf("memory allocation for timers failed.");
+      exit(EXIT_FAILURE);
     }
-  printf("Warning: unable to cancel your timer. It wasn't running.\n");
+    for (i = c->nidtimers[AorB]; i < n; i++)
+      grown[i] = NULL;
+    c->idtimers[AorB] = grown;
+    c->nidtimers[AorB] = n;
+  }
+  return &c->idtimers[AorB][id];
 }
 
-
-void starttimer(int AorB, double increment)
-/* A or B is trying to start timer */
+static void canceltimer(struct simulation *sim, int AorB, int id)
 {
+  struct event **slot = timerslot(sim, AorB, id);
+  struct event *q = *slot;
 
-  struct event *q;
+  if (q != NULL) {
+    /* remove this event */
+    evq_remove(&sim->evlist, q);
+    evq_release(&sim->evlist, q);
+    *slot = NULL;
+    return;
+  }
+  printf("Warning: unable to cancel your timer. It wasn't running.\n");
+}
+
+static void armtimer(struct simulation *sim, int AorB, int id, double increment)
+{
+  struct event **slot = timerslot(sim, AorB, id);
   struct event *evptr;
 
-  if (TRACE>1)
-    printf("          START TIMER: starting timer at %f\n",time);
   /* be nice: check to see if timer is already started, if so, then  warn */
-  /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next)  */
-  for (q=evlist; q!=NULL ; q = q->next)  
-    if ( (q->evtype==TIMER_INTERRUPT  && q->eventity==AorB) ) { 
-      printf("Warning: attempt to start a timer that is already started\n");
-      return;
-    }
+  if (*slot != NULL) {
+    printf("Warning: attempt to start a timer that is already started\n");
+    return;
+  }
  
   /* create future event for when timer goes off */
-  evptr = malloc(sizeof(struct event));
-  if (evptr == 0) {
-    printf("memory allocation for event failed.");
-    exit(EXIT_FAILURE);
-  }
-  evptr->evtime =  time + increment;
+  evptr = evq_alloc(&sim->evlist);
+  evptr->evtime =  sim->time + increment;
   evptr->evtype =  TIMER_INTERRUPT;
-   
- 
   evptr->eventity = AorB;
-  insertevent(evptr);
+  evptr->evconn = (int)(sim->conn - sim->conns);
+  evptr->evtimerid = id;
+  *slot = evptr;
+  insertevent(sim, evptr);
+}
+
+/* called by students routine to cancel a previously-started timer */
+void stoptimer(struct simulation *sim, int AorB)
+/* A or B is trying to stop timer */
+{
+  TRACE_EVENT(sim, STOP_TIMER, sim->time);
+  canceltimer(sim, AorB, NOTIMERID);
+}
+
+
+void starttimer(struct simulation *sim, int AorB, double increment)
+/* A or B is trying to start timer */
+{
+  TRACE_EVENT(sim, START_TIMER, sim->time);
+  armtimer(sim, AorB, NOTIMERID, increment);
 } 
 
+/* timer id (>= 0) of A or B; independent of each other and of the timer */
+/* above.  When it goes off A_timerinterrupt_id(id) or B_... is called   */
+void stoptimer_id(struct simulation *sim, int AorB, int id)
+{
+  TRACE_EVENT(sim, STOP_TIMER_ID, id, sim->time);
+  canceltimer(sim, AorB, id);
+}
+
+void starttimer_id(struct simulation *sim, int AorB, int id, double increment)
+{
+  TRACE_EVENT(sim, START_TIMER_ID, id, sim->time);
+  armtimer(sim, AorB, id, increment);
+}
+
 
 /************************** TOLAYER3 ***************/
-void tolayer3(int AorB, struct pkt packet)
-/* A or B is sending to network  */
+/* a packet lives in the arrival event that carries it, so a buffer */
+/* handed out by pkt_alloc() is the pkt of a fresh event node        */
+#define PKT_EVENT(p) ((struct event *)((char *)(p) - offsetof(struct event, pkt)))
+
+struct pkt *pkt_alloc(struct simulation *sim)
 {
-  struct pkt *mypktptr;
-  struct event *evptr,*q;
+  return &evq_alloc(&sim->evlist)->pkt;
+}
+
+/* the medium takes the packet of evptr, sent by AorB of the connection  */
+/* evptr->evconn of sim at time now: it is lost, or scheduled to arrive, */
+/* perhaps damaged.  The channel is that of net, which sim shares        */
+static void medium(struct simulation *net, struct simulation *sim, int AorB, struct event *evptr, float now)
+{
+  const struct sim_config *cfg = &net->cfg;
+  struct connection *c = &sim->conns[evptr->evconn];
+  struct pkt *packet = &evptr->pkt;
+  struct channel *link = &net->link[(AorB+1) % 2];
+  const struct evlog_rec *r;
   float lastime, x;
-  int i;
+  double draw, sent = now, lossprob = cfg->lossprob;
+  int fate, corrupt, full = 0;
 
-  ntolayer3++;
+  /* when replaying, r says what the channel does; else the dice decide */
+  r = replayed(net, EVL_SEND, AorB);
+
+  /* the link drops the packet if its buffer is full, and sends it on */
+  /* if not; losses are more likely while the burst chain is bad       */
+  if (cfg->channel == SIM_CHANNEL_LINK) {
+    full = !channel_room(link, now, cfg->buffer);
+    if (r != NULL)
+      full = r->fate == EVL_DROPPED;
+    if (!full)
+      sent = channel_send(link, now, CHANNEL_HEADER + packet->length, cfg->bandwidth, cfg->buffer);
+    if (r == NULL && (INSTEP(net) || cfg->goodbad > 0.0) &&
+        channel_step(link, jimsrand(net, RNG_CHANNEL), cfg->goodbad, cfg->badgood))
+      lossprob = cfg->badloss;
+  }
 
   /* simulate losses: */
-  if (jimsrand() < lossprob && (!(AorB == B && corruptdirection == A) && !(AorB == A && corruptdirection == B))) {
-    nlost++;
-    if (TRACE>0)    
-      printf("          TOLAYER3: packet being lost\n");
+  if (r != NULL ? r->fate == EVL_LOST || r->fate == EVL_DROPPED :
+      (jimsrand(net, RNG_LOSS) < lossprob && (!(AorB == B && cfg->corruptdirection == A) && !(AorB == A && cfg->corruptdirection == B))) || full) {
+    if (r == NULL && INSTEP(net)) {
+      (void)jimsrand(net, RNG_DELAY);
+      (void)jimsrand(net, RNG_CORRUPT);
+      (void)jimsrand(net, RNG_CORRUPT);
+    }
+    c->stats.nlost++;
+    if (full) {
+      c->stats.ndropped++;
+      TRACE_EVENT(sim, L3_DROPPED);
+    }
+    else
+      TRACE_EVENT(sim, L3_LOST);
+    if (LOGGING(sim))
+      logrec(sim, EVL_SEND, AorB, packet, full ? EVL_DROPPED : EVL_LOST, NOTIMERID, 0.0);
+    evq_release(&sim->evlist, evptr);
     return;
   }  
 
-  /* make a copy of the packet student just gave me since he/she may decide */
-  /* to do something with the packet after we return back to him/her */ 
-  mypktptr = malloc(sizeof(struct pkt));
-  if (mypktptr == 0) {
-    printf("memory allocation for event failed.");
-    exit(EXIT_FAILURE);
-  }
-  mypktptr->seqnum = packet.seqnum;
-  mypktptr->acknum = packet.acknum;
-  mypktptr->checksum = packet.checksum;
-  for (i=0; i<20; i++)
-    mypktptr->payload[i] = packet.payload[i];
-  if (TRACE>2)  {
-    printf("          TOLAYER3: seq: %d, ack %d, check: %d ", mypktptr->seqnum,
-           mypktptr->acknum,  mypktptr->checksum);
-    for (i=0; i<20; i++)
-      printf("%c",mypktptr->payload[i]);
-    printf("\n");
-  }
+  TRACE_EVENT(sim, L3_PACKET, packet->seqnum, packet->acknum, packet->checksum,
+              packet->payload);
 
   /* create future event for arrival of packet at the other side */
-  evptr = malloc(sizeof(struct event));
-  if (evptr == 0) {
-    printf("memory allocation for event failed.");
-    exit(EXIT_FAILURE);
-  }
   evptr->evtype =  FROM_LAYER3;   /* packet will pop out from layer3 */
   evptr->eventity = (AorB+1) % 2; /* event occurs at other entity */
-  evptr->pktptr = mypktptr;       /* save ptr to my copy of packet */
   /* finally, compute the arrival time of packet at the other end.
      medium can not reorder, so make sure packet arrives between 1 and 10
      time units after the latest arrival time of packets
-     currently in the medium on their way to the destination */
-  lastime = time;
-  /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next) */
-  for (q=evlist; q!=NULL ; q = q->next) 
-    if ( (q->evtype==FROM_LAYER3  && q->eventity==evptr->eventity) ) 
-      lastime = q->evtime;
-  evptr->evtime =  lastime + 1 + 9*jimsrand();
+     currently in the medium on their way to the destination.
+     Arrivals on a channel are scheduled in increasing time order, so the
+     latest one still in the medium is the last one scheduled, unless it
+     has already popped out, in which case it is no later than now. */
+  lastime = net->lastarrival[evptr->eventity];
+  draw = r != NULL ? r->delaydraw : jimsrand(net, RNG_DELAY);
+  if (cfg->channel == SIM_CHANNEL_LINK) {
+    /* the propagation delay runs from when the packet is sent; the   */
+    /* medium still does not reorder, so it may have to wait for one  */
+    /* that was delayed more.  It arrives just after that one, not at */
+    /* the same time: equal times pop newest first (see evqueue.h)    */
+    evptr->evtime = sent + channel_delay(cfg->delay, cfg->delaymean, draw);
+    if (evptr->evtime <= lastime)
+      evptr->evtime = nextafterf(lastime, INFINITY);
+  }
+  else {
+    if (lastime < now)
+      lastime = now;
+    evptr->evtime =  lastime + 1 + 9*draw;
+  }
+  net->lastarrival[evptr->eventity] = evptr->evtime;
  
 
 
   /* simulate corruption: */
-  if ((jimsrand() < corruptprob)  && (!(AorB == B && corruptdirection == A) && !(AorB == A && corruptdirection == B))) {
-    ncorrupt++;
-    if ( (x = jimsrand()) < .75)
-      mypktptr->payload[0]='Z';   /* corrupt payload */
+  fate = EVL_DELIVERED;
+  corrupt = r != NULL ? r->fate != EVL_DELIVERED :
+    (jimsrand(net, RNG_CORRUPT) < cfg->corruptprob)  && (!(AorB == B && cfg->corruptdirection == A) && !(AorB == A && cfg->corruptdirection == B));
+  if (r == NULL && (corrupt || INSTEP(net)))
+    x = jimsrand(net, RNG_CORRUPT);
+  if (corrupt) {
+    c->stats.ncorrupt++;
+    if (r != NULL)
+      fate = r->fate;
+    else if ( x < .75)
+      fate = EVL_CORRUPT_DATA;
     else if (x < .875)
-      mypktptr->seqnum = 999999;
+      fate = EVL_CORRUPT_SEQ;
     else
-      mypktptr->acknum = 999999;
-    if (TRACE>0)    
-      printf("          TOLAYER3: packet being corrupted\n");
+      fate = EVL_CORRUPT_ACK;
+  }
+  /* the log keeps the packet as it was sent, so log before damaging it */
+  evptr->evfate = fate;
+  if (LOGGING(sim))
+    logrec(sim, EVL_SEND, AorB, packet, fate, NOTIMERID, draw);
+  if (corrupt) {
+    if (fate == EVL_CORRUPT_DATA && packet->length > 0)
+      packet->payload[0]='Z';   /* corrupt payload */
+    else if (fate == EVL_CORRUPT_DATA)
+      packet->checksum ^= 1;    /* nothing to damage but the checksum */
+    else if (fate == EVL_CORRUPT_SEQ)
+      packet->seqnum = 999999;
+    else
+      packet->acknum = 999999;
+    TRACE_EVENT(sim, L3_CORRUPT);
   }  
 
-  if (TRACE>2)  
-    printf("          TOLAYER3: scheduling arrival on other side\n");
-  insertevent(evptr);
+  TRACE_EVENT(sim, L3_SCHEDULE);
+  insertevent(sim, evptr);
+  sim->inflight++;
+  c->inflight_area += evptr->evtime - now;
 } 
 
-void tolayer5(int AorB, char datasent[20])
+void tolayer3_pkt(struct simulation *sim, int AorB, struct pkt *packet)
+/* A or B is sending to network the packet it built in place */
 {
-  int i;  
-  if (TRACE>2) {
-    printf("          TOLAYER5: data received by application at ");
-    if (AorB == A) 
-      printf("A: ");
-    else
-      printf("B: ");
-    for (i=0; i<20; i++)  
-      printf("%c",datasent[i]);
-    printf("\n");
+  struct event *evptr = PKT_EVENT(packet);
+  struct event **grown;
+  int n;
+
+  if (packet->length < 0 || packet->length > sim->cfg.mtu) {
+    printf("a packet of %d bytes does not fit the MTU of %d\n", packet->length, sim->cfg.mtu);
+    exit(EXIT_FAILURE);
+  }
+  sim->conn->stats.ntolayer3++;
+  packet->conn = sim->conn->id;   /* the header says whose packet it is */
+  evptr->evconn = (int)(sim->conn - sim->conns);
+  if (sim->net == sim) {
+    medium(sim, sim, AorB, evptr, sim->time);
+    return;
+  }
+
+  /* a shard: the medium takes the packet at the end of the window */
+  if (sim->noutbox == sim->outboxsize) {
+    n = sim->outboxsize ? 2 * sim->outboxsize : 64;
+    grown = realloc(sim->outbox, n * sizeof(struct event *));
+    if (grown == NULL) {
+      printf("memory allocation for packets sent failed.");
+      exit(EXIT_FAILURE);
+    }
+    sim->outbox = grown;
+    sim->outboxsize = n;
+  }
+  evptr->evtime = sim->time;
+  evptr->eventity = AorB;
+  sim->outbox[sim->noutbox++] = evptr;
+}
+
+void tolayer3(struct simulation *sim, int AorB, struct pkt packet)
+/* A or B is sending to network  */
+{
+  struct pkt *mypktptr;
+
+  /* make a copy of the packet student just gave me since he/she may decide */
+  /* to do something with the packet after we return back to him/her */ 
+  mypktptr = pkt_alloc(sim);
+  *mypktptr = packet;
+  tolayer3_pkt(sim, AorB, mypktptr);
+}
+
+/* account for one message passed up to AorB */
+static void delivered(struct simulation *sim, int AorB, const char *datasent, int length)
+{
+  struct connection *c = sim->conn;
+  struct handoffs *h = &c->handoff[(AorB+1) % 2];   /* sent by the other side */
+
+  (void)datasent;               /* only the trace shows it */
+  if (AorB == A)
+    TRACE_EVENT(sim, L5_DATA_A, datasent);
+  else
+    TRACE_EVENT(sim, L5_DATA_B, datasent);
+  c->stats.messages_delivered++;
+  c->stats.bytes_delivered += length;
+  if (h->count > 0) {
+    hist_add(&c->latency, sim->time - h->time[h->first]);
+    if (++h->first == h->size)
+      h->first = 0;
+    h->count--;
+  }
+}
+
+/* account for one hand-over of count messages */
+static void handed_up(struct simulation *sim, int count)
+{
+  struct sim_stats *st = &sim->conn->stats;
+
+  st->deliveries++;
+  if (count > st->peak_batch)
+    st->peak_batch = count;
+}
+
+void tolayer5(struct simulation *sim, int AorB, const char *datasent, int length)
+{
+  delivered(sim, AorB, datasent, length);
+  handed_up(sim, 1);
+}
+
+void tolayer5_batch(struct simulation *sim, int AorB, const struct pkt *pkts, int count)
+{
+  int i;
+
+  for (i = 0; i < count; i++)
+    delivered(sim, AorB, pkts[i].payload, pkts[i].length);
+  handed_up(sim, count);
+}
+
+/* note that a message from AorB has been handed to layer 4 now */
+static void handed_off(struct simulation *sim, int AorB)
+{
+  struct handoffs *h = &sim->conn->handoff[AorB];
+  float *grown;
+  int i, n;
+
+  if (h->count == h->size) {
+    n = h->size ? 2 * h->size : 64;
+    grown = malloc(n * sizeof(float));
+    if (grown == NULL) {
+      printf("memory allocation for message times failed.");
+      exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < h->count; i++)
+      grown[i] = h->time[(h->first + i) % h->size];
+    free(h->time);
+    h->time = grown;
+    h->size = n;
+    h->first = 0;
+  }
+  h->time[(h->first + h->count) % h->size] = sim->time;
+  h->count++;
+}
+
+/* the figures of merit from the statistics st, the latencies lat and */
+/* the time packets spent in the medium                               */
+static void figures(struct sim_stats *st, const struct histogram *lat, double inflight_area)
+{
+  st->goodput = st->sim_time > 0 ? st->messages_delivered / st->sim_time : 0.0;
+  st->throughput = st->sim_time > 0 ? st->bytes_delivered / st->sim_time : 0.0;
+  st->latency_mean = lat->count > 0 ? lat->sum / lat->count : 0.0;
+  st->latency_p50 = hist_quantile(lat, 0.50);
+  st->latency_p95 = hist_quantile(lat, 0.95);
+  st->latency_p99 = hist_quantile(lat, 0.99);
+  st->latency_max = hist_quantile(lat, 1.0);
+  st->avg_inflight = st->sim_time > 0 ? inflight_area / st->sim_time : 0.0;
+}
+
+/* work out the figures of merit of a finished run, for each connection */
+/* and for them all.  The totals add up the counts of the connections;  */
+/* the peaks are the highest of theirs and the timer and window figures */
+/* the mean of those that have them                                     */
+static void results(struct simulation *sim, int peak_events)
+{
+  struct sim_stats *st = &sim->stats, *cs;
+  struct connection *c;
+  int i, nrtt = 0, nrto = 0, ncwnd = 0;
+
+  memset(st, 0, sizeof(*st));
+  hist_init(&sim->latency);
+  for (i = 0; i < sim->nconns; i++) {
+    c = &sim->conns[i];
+    cs = &c->stats;
+    cs->sim_time = sim->time;
+    figures(cs, &c->latency, c->inflight_area);
+    hist_merge(&sim->latency, &c->latency);
+    st->window_full += cs->window_full;
+    st->total_ACKs_received += cs->total_ACKs_received;
+    st->packets_resent += cs->packets_resent;
+    st->fast_retransmits += cs->fast_retransmits;
+    st->new_ACKs += cs->new_ACKs;
+    st->packets_received += cs->packets_received;
+    st->msgs_queued += cs->msgs_queued;
+    st->queue_delay += cs->queue_delay;
+    if (cs->peak_queue > st->peak_queue)
+      st->peak_queue = cs->peak_queue;
+    if (cs->smoothed_RTT > 0.0) {
+      st->smoothed_RTT += cs->smoothed_RTT;
+      nrtt++;
+    }
+    if (cs->current_RTO > 0.0) {
+      st->current_RTO += cs->current_RTO;
+      nrto++;
+    }
+    if (cs->cwnd > 0.0) {
+      st->cwnd += cs->cwnd;
+      ncwnd++;
+    }
+    st->nsim += cs->nsim;
+    st->messages_delivered += cs->messages_delivered;
+    st->bytes_delivered += cs->bytes_delivered;
+    st->deliveries += cs->deliveries;
+    if (cs->peak_batch > st->peak_batch)
+      st->peak_batch = cs->peak_batch;
+    st->ntolayer3 += cs->ntolayer3;
+    st->nlost += cs->nlost;
+    st->ndropped += cs->ndropped;
+    st->ncorrupt += cs->ncorrupt;
+    st->nevents += cs->nevents;
   }
-  messages_delivered++;
+  if (nrtt > 0)
+    st->smoothed_RTT /= nrtt;
+  if (nrto > 0)
+    st->current_RTO /= nrto;
+  if (ncwnd > 0)
+    st->cwnd /= ncwnd;
+  st->sim_time = sim->time;
+  st->peak_events = peak_events;
+  figures(st, &sim->latency, sim->inflight_area);
+  sim->current = st;
 }
 
-int main(void)
+/* simulate the events before time end, or until none are left */
+static void simulate(struct simulation *sim, double end)
 {
   struct event *eventptr;
+  struct connection *c;
   struct msg  msg2give;
-  struct pkt  pkt2give;
-   
-  int i,j;
-  
-  init();
-  A_init();
-  B_init();
    
-  while (1) {
-    eventptr = evlist;            /* get next event to simulate */
-    if (eventptr==NULL)
-      goto terminate;
-    evlist = evlist->next;        /* remove this event from event list */
-    if (evlist!=NULL)
-      evlist->prev=NULL;
-    if (TRACE>=2) {
-      printf("\nEVENT time: %f,",eventptr->evtime);
-      printf("  type: %d",eventptr->evtype);
-      if (eventptr->evtype==0)
-        printf(", timerinterrupt  ");
-      else if (eventptr->evtype==1)
-        printf(", fromlayer5 ");
+  int i,j, dropped;
+
+  while ((eventptr = evq_peek(&sim->evlist)) != NULL && eventptr->evtime < end) {
+    eventptr = evq_pop(&sim->evlist);  /* get next event to simulate */
+    if (eventptr->evtype == TIMER_INTERRUPT)
+      TRACE_EVENT(sim, EVENT_TIMER, eventptr->evtime, eventptr->eventity);
+    else if (eventptr->evtype == FROM_LAYER5)
+      TRACE_EVENT(sim, EVENT_LAYER5, eventptr->evtime, eventptr->eventity);
+    else
+      TRACE_EVENT(sim, EVENT_LAYER3, eventptr->evtime, eventptr->eventity);
+    c = &sim->conns[eventptr->evconn];
+    use_connection(sim, c);
+    sim->inflight_area += sim->inflight * (eventptr->evtime - sim->time);
+    sim->time = eventptr->evtime;   /* update time to next event time */
+    c->stats.nevents++;
+    if (LOGGING(sim)) {
+      if (eventptr->evtype == TIMER_INTERRUPT)
+        logrec(sim, EVL_TIMER, eventptr->eventity, NULL, EVL_DELIVERED, eventptr->evtimerid, 0.0);
+      else if (eventptr->evtype == FROM_LAYER5)
+        logrec(sim, EVL_LAYER5, eventptr->eventity, NULL, EVL_DELIVERED, NOTIMERID, 0.0);
       else
-        printf(", fromlayer3 ");
-      printf(" entity: %d\n",eventptr->eventity);
+        logrec(sim, EVL_LAYER3, eventptr->eventity, &eventptr->pkt, eventptr->evfate, NOTIMERID, 0.0);
     }
-    time = eventptr->evtime;        /* update time to next event time */
     if (eventptr->evtype == FROM_LAYER5 ) {
-      if (nsim < nsimmax) {
-        generate_next_arrival();   /* set up future arrival */
+      if (sim->nsim < sim->cfg.nsimmax) {
+        generate_next_arrival(sim);   /* set up future arrival */
         /* fill in msg to give with string of same letter */    
-        j = nsim % 26; 
-        for (i=0; i<20; i++)  
+        j = sim->nsim % 26; 
+        msg2give.length = sim->cfg.msgsize;
+        for (i=0; i<msg2give.length; i++)  
           msg2give.data[i] = 97 + j;
-        if (TRACE>2) {
-          printf("          MAINLOOP: data given to student: ");
-          for (i=0; i<20; i++) 
-            printf("%c", msg2give.data[i]);
-          printf("\n");
-        }
-        nsim++;
+        for (; i<20; i++)             /* the part a trace shows */
+          msg2give.data[i] = 0;
+        TRACE_EVENT(sim, MAIN_DATA, msg2give.data);
+        sim->nsim++;
+        c->stats.nsim++;
+        /* a protocol counts the messages it has no room for in window_full */
+        dropped = c->stats.window_full;
         if (eventptr->eventity == A) 
-          A_output(msg2give);  
+          sim->proto->A_output(sim, msg2give);
         else
-          B_output(msg2give);  
+          sim->proto->B_output(sim, msg2give);
+        if (c->stats.window_full == dropped)
+          handed_off(sim, eventptr->eventity);
       }
-      else if (TRACE > 2)
-          printf("          FROM_LAYER5: no more messages to send: \n");
+      else
+        TRACE_EVENT(sim, NO_MORE_MSGS);
     }
     else if (eventptr->evtype ==  FROM_LAYER3) {
-      pkt2give.seqnum = eventptr->pktptr->seqnum;
-      pkt2give.acknum = eventptr->pktptr->acknum;
-      pkt2give.checksum = eventptr->pktptr->checksum;
-      for (i=0; i<20; i++)  
-        pkt2give.payload[i] = eventptr->pktptr->payload[i];
-	    if (eventptr->eventity ==A)      /* deliver packet by calling */
-        A_input(pkt2give);            /* appropriate entity */
+      if (eventptr->evseq < sim->lastseq[eventptr->eventity]) {
+        printf("INTERNAL PANIC: the medium reordered the packets to %c\n", "AB"[eventptr->eventity]);
+        exit(EXIT_FAILURE);
+      }
+      sim->lastseq[eventptr->eventity] = eventptr->evseq;
+      sim->inflight--;
+      /* the entity reads the packet where it is; it is recycled below */
+      if (eventptr->eventity ==A)      /* deliver packet by calling */
+        sim->proto->A_input(sim, &eventptr->pkt);   /* appropriate entity */
       else
-        B_input(pkt2give);
-	    free(eventptr->pktptr);          /* free the memory for packet */
+        sim->proto->B_input(sim, &eventptr->pkt);
     }
     else if (eventptr->evtype ==  TIMER_INTERRUPT) {
-      if (eventptr->eventity == A) 
-        A_timerinterrupt();
+      /* clear the handle first: the handler may restart the timer */
+      *timerslot(sim, eventptr->eventity, eventptr->evtimerid) = NULL;
+      if (eventptr->evtimerid != NOTIMERID) {
+        if (eventptr->eventity == A) 
+          sim->proto->A_timerinterrupt_id(sim, eventptr->evtimerid);
+        else
+          sim->proto->B_timerinterrupt_id(sim, eventptr->evtimerid);
+      }
+      else if (eventptr->eventity == A) 
+        sim->proto->A_timerinterrupt(sim);
       else
-        B_timerinterrupt();
+        sim->proto->B_timerinterrupt(sim);
     }
     else  {
       printf("INTERNAL PANIC: unknown event type \n");
     }
-    free(eventptr);
+    evq_release(&sim->evlist, eventptr);  /* recycle event (and packet) */
+  }
+}
+
+/* set up the entities of every connection */
+static void start_entities(struct simulation *sim)
+{
+  int i;
+
+  for (i = 0; i < sim->nconns; i++) {
+    use_connection(sim, &sim->conns[i]);
+    sim->proto->A_init(sim);
+    sim->proto->B_init(sim);
+  }
+}
+
+/********************* CHECKPOINTS *************************/
+/*  With --checkpoint, a run stops every --interval of      */
+/*  simulated time to write all of its state to a file (see */
+/*  checkpoint.h), and --restore sets a run up from such a  */
+/*  file instead of from the start.  The pending events     */
+/*  keep their evseq, and the random numbers their state,   */
+/*  so a restored run goes on exactly as the one that wrote */
+/*  the checkpoint does.  A --seed other than the one of    */
+/*  the checkpoint draws them afresh from there on, to fork */
+/*  variants of a run from one warmed up state.  Where a    */
+/*  run writes its output is not part of its state: a       */
+/*  restored run only writes checkpoints, logs and JSON if  */
+/*  it is asked to, so the checkpoint it starts from stays  */
+/*  as it was for the next run to fork from.                */
+/************************************************************/
+
+/* the settings the state in a checkpoint depends on, which a restored */
+/* run may not change                                                  */
+static const char *const fixed_settings[] = {
+  "rng", "protocol", "window", "seqspace", "queue", "mtu", "msgsize", "flows", "channel", NULL
+};
+
+/* the settings of where a run writes its output, which a restored run */
+/* does not take from the checkpoint                                   */
+static const char *const output_settings[] = {
+  "tracefile", "eventlog", "json", "checkpoint", "interval", NULL
+};
+
+/* whether name is one of the settings in list */
+static int listed(const char *const *list, const char *name)
+{
+  for (; *list != NULL; list++)
+    if (strcmp(*list, name) == 0)
+      return 1;
+  return 0;
+}
+
+/* the message times of h, of which there are at most most */
+static void handoffs_io(struct ckpt *ck, struct handoffs *h, int most)
+{
+  int i, n = ckpt_count(ck, h->count, most);
+
+  if (ck->reading) {
+    free(h->time);
+    h->time = NULL;
+    if (n > 0 && (h->time = malloc(n * sizeof(float))) == NULL) {
+      printf("memory allocation for message times failed.");
+      exit(EXIT_FAILURE);
+    }
+    h->size = n;
+    h->first = 0;
+    h->count = n;
   }
+  for (i = 0; i < n; i++)
+    CKPT_IO(ck, h->time[(h->first + i) % h->size]);
+}
 
- terminate:
-  printf(" Simulator terminated at time %f\n after attempting to send %d msgs from layer5\n",time,nsim);
-  printf("number of messages dropped due to full window:  %d \n", window_full);
-  printf("number of valid (not corrupt or duplicate) acknowledgements received at A:  %d \n", new_ACKs);
+/* the pending events, and the timers that refer to them */
+static void events_io(struct simulation *sim, struct ckpt *ck)
+{
+  struct evqueue *q = &sim->evlist;
+  struct event *p;
+  int i, n, peak = q->peak;
+
+  CKPT_IO(ck, q->nextseq);
+  CKPT_IO(ck, peak);
+  n = ckpt_count(ck, q->size, INT_MAX);
+  for (i = 0; i < n; i++) {
+    p = ck->reading ? evq_alloc(q) : q->heap[i];
+    CKPT_IO(ck, p->evtime);
+    CKPT_IO(ck, p->evtype);
+    p->eventity = ckpt_count(ck, p->eventity, B);
+    p->evconn = ckpt_count(ck, p->evconn, sim->nconns - 1);
+    CKPT_IO(ck, p->pkt);
+    CKPT_IO(ck, p->evtimerid);
+    CKPT_IO(ck, p->evfate);
+    CKPT_IO(ck, p->evseq);
+    if (!ck->reading)
+      continue;
+    if (p->evtype == TIMER_INTERRUPT) {
+      sim->conn = &sim->conns[p->evconn];
+      *timerslot(sim, p->eventity, p->evtimerid) = p;
+    }
+    evq_restore(q, p);
+  }
+  q->peak = peak;
+}
+
+/* all the state of a run but its settings, to or from ck */
+static void state_io(struct simulation *sim, struct ckpt *ck)
+{
+  struct connection *c;
+  int i;
+
+  CKPT_IO(ck, sim->time);
+  CKPT_IO(ck, sim->nsim);
+  CKPT_IO(ck, sim->rng);
+  CKPT_IO(ck, sim->lastarrival);
+  CKPT_IO(ck, sim->lastseq);
+  channel_io(ck, &sim->link[A]);
+  channel_io(ck, &sim->link[B]);
+  CKPT_IO(ck, sim->inflight);
+  CKPT_IO(ck, sim->inflight_area);
+  for (i = 0; i < sim->nconns; i++) {
+    c = &sim->conns[i];
+    CKPT_IO(ck, c->stats);
+    handoffs_io(ck, &c->handoff[A], sim->nsim);
+    handoffs_io(ck, &c->handoff[B], sim->nsim);
+    CKPT_IO(ck, c->latency);
+    CKPT_IO(ck, c->inflight_area);
+  }
+  events_io(sim, ck);
+  /* the events choose the connection to run as they come, so this */
+  /* leaves no trace                                                */
+  for (i = 0; i < sim->nconns; i++) {
+    sim->conn = &sim->conns[i];
+    sim->current = &sim->conn->stats;
+    sim->proto->checkpoint(sim, ck);
+  }
+}
+
+/* write the state of the run, simulated up to time upto, to --checkpoint */
+static void save_checkpoint(struct simulation *sim, double upto)
+{
+  struct ckpt ck;
+
+  ckpt_create(&ck, sim->cfg.checkpoint);
+  CKPT_IO(&ck, sim->cfg);
+  CKPT_IO(&ck, upto);
+  state_io(sim, &ck);
+  ckpt_close(&ck);
+  TRACE_EVENT(sim, CHECKPOINT, upto);
+}
+
+/* give the settings that were not given, but for those of the output, */
+/* the values they had in the run of the checkpoint ck; those the state */
+/* depends on must have them.  Returns whether --seed asks for new      */
+/* random numbers                                                       */
+static int restore_config(struct simulation *sim, struct ckpt *ck)
+{
+  struct sim_config saved;
+  char *mine, *theirs;
+  size_t size;
+  int i;
+
+  CKPT_IO(ck, saved);
+  for (i = 0; i < NSETTINGS; i++) {
+    mine = (char *)&sim->cfg + settings[i].offset;
+    theirs = (char *)&saved + settings[i].offset;
+    size = settings[i].type == 's' ? SIM_PATHMAX : settings[i].type == 'f' ? sizeof(float) : sizeof(int);
+    if (!sim->given[i]) {
+      if (!listed(output_settings, settings[i].name))
+        memcpy(mine, theirs, size);
+      sim->given[i] = 1;
+      continue;
+    }
+    if (listed(fixed_settings, settings[i].name) && memcmp(mine, theirs, size) != 0) {
+      printf("--%s cannot be changed for a restored run: its state depends on it\n", settings[i].name);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (sim->cfg.protocol < 0 || sim->cfg.protocol >= (int)(sizeof(protocols) / sizeof(protocols[0]))) {
+    printf("checkpoint %s is damaged\n", ck->path);
+    exit(EXIT_FAILURE);
+  }
+  return sim->cfg.seed != saved.seed;
+}
+
+/* set the run up from the checkpoint ck, in place of init() and */
+/* start_entities(); returns the time it was simulated up to     */
+static double restore_state(struct simulation *sim, struct ckpt *ck, int reseed)
+{
+  double upto;
+
+  reset(sim);
+  CKPT_IO(ck, upto);
+  state_io(sim, ck);
+  if (reseed)
+    rng_seed(&sim->rng, sim->rng.kind, sim->cfg.seed);
+  TRACE_EVENT(sim, RESTORED, upto);
+  return upto;
+}
+
+/* simulate the rest of the run, from time from, stopping every */
+/* --interval to write a --checkpoint if one is wanted           */
+static void run_from(struct simulation *sim, double from)
+{
+  struct event *next;
+  double upto;
+
+  if (sim->cfg.checkpoint[0] == '\0') {
+    simulate(sim, HUGE_VAL);
+    return;
+  }
+  for (upto = from + sim->cfg.interval; (next = evq_peek(&sim->evlist)) != NULL; upto += sim->cfg.interval)
+    if (next->evtime < upto) {
+      simulate(sim, upto);
+      if (evq_peek(&sim->evlist) != NULL)
+        save_checkpoint(sim, upto);
+    }
+}
+
+/********************* SHARDED RUNS *************************/
+/*  With --threads N, the connections of a run are dealt    */
+/*  out to N shards, each a simulation of its own with its  */
+/*  own clock, events and arrivals, run on a thread of its  */
+/*  own.  Only the medium is shared.  No packet takes less  */
+/*  than LOOKAHEAD to go through it, so each shard can run  */
+/*  up to LOOKAHEAD past the earliest pending event of all  */
+/*  of them on its own: nothing sent in that window arrives */
+/*  before it ends.  Between windows one thread takes the   */
+/*  packets sent in it through the medium, in the order     */
+/*  they were sent, and the next window begins.             */
+/************************************************************/
+
+#if SIM_THREADS
+#define LOOKAHEAD 1.0   /* the least time a packet spends in the medium */
+
+/* all threads wait at it until the last one arrives */
+struct barrier {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int count, waiting, round;
+};
+
+static void barrier_wait(struct barrier *b)
+{
+  int round;
+
+  pthread_mutex_lock(&b->lock);
+  round = b->round;
+  if (++b->waiting == b->count) {
+    b->waiting = 0;
+    b->round++;
+    pthread_cond_broadcast(&b->cond);
+  }
+  else
+    while (b->round == round)
+      pthread_cond_wait(&b->cond, &b->lock);
+  pthread_mutex_unlock(&b->lock);
+}
+
+struct sharding {
+  struct simulation *net;       /* the run as a whole, whose medium it is */
+  struct simulation **shard;
+  int nshards;
+  double end;                   /* where the window being run ends */
+  int done;                     /* set when no shard has an event left */
+  struct barrier barrier;
+};
+
+/* a packet from an outbox, and where it was in them, for sorting */
+struct sent {
+  struct event *ev;
+  int shard, order;
+};
+
+static int by_send_time(const void *a, const void *b)
+{
+  const struct sent *x = a, *y = b;
+
+  if (x->ev->evtime != y->ev->evtime)
+    return x->ev->evtime < y->ev->evtime ? -1 : 1;
+  if (x->shard != y->shard)
+    return x->shard - y->shard;
+  return x->order - y->order;
+}
+
+/* take the packets sent in the last window through the medium, and */
+/* work out where the next window ends                              */
+static void exchange(struct sharding *sh)
+{
+  struct simulation *shard;
+  struct sent *sent;
+  struct event *next;
+  double first = HUGE_VAL;
+  int s, i, n = 0;
+
+  for (s = 0; s < sh->nshards; s++)
+    n += sh->shard[s]->noutbox;
+  sent = malloc((n > 0 ? n : 1) * sizeof(struct sent));
+  if (sent == NULL) {
+    printf("memory allocation for packets sent failed.");
+    exit(EXIT_FAILURE);
+  }
+  n = 0;
+  for (s = 0; s < sh->nshards; s++) {
+    shard = sh->shard[s];
+    for (i = 0; i < shard->noutbox; i++) {
+      sent[n].ev = shard->outbox[i];
+      sent[n].shard = s;
+      sent[n++].order = i;
+    }
+    shard->noutbox = 0;
+  }
+  qsort(sent, n, sizeof(struct sent), by_send_time);
+  for (i = 0; i < n; i++)
+    medium(sh->net, sh->shard[sent[i].shard], sent[i].ev->eventity, sent[i].ev, sent[i].ev->evtime);
+  free(sent);
+
+  for (s = 0; s < sh->nshards; s++)
+    if ((next = evq_peek(&sh->shard[s]->evlist)) != NULL && next->evtime < first)
+      first = next->evtime;
+  sh->done = first == HUGE_VAL;
+  sh->end = first + LOOKAHEAD;
+}
+
+struct worker {
+  struct sharding *sh;
+  int index;
+};
+
+/* run shard index window by window; worker 0 does the exchanges */
+static void *shard_worker(void *arg)
+{
+  struct worker *w = arg;
+  struct sharding *sh = w->sh;
+
+  while (!sh->done) {
+    simulate(sh->shard[w->index], sh->end);
+    barrier_wait(&sh->barrier);
+    if (w->index == 0)
+      exchange(sh);
+    barrier_wait(&sh->barrier);
+  }
+  return NULL;
+}
+
+/* run sim as n shards.  Shard s has connections s, s + n, s + 2n ...,  */
+/* and as big a part of the messages and of the arrival rate; its      */
+/* arrivals come from seed + 1 + s, the medium from the seed of sim    */
+static void shards(struct simulation *sim, int n)
+{
+  const struct sim_config *cfg = &sim->cfg;
+  struct sharding sh;
+  struct worker *w;
+  pthread_t *tid;
+  struct simulation *shard;
+  struct connection *from, *to;
+  int s, i, mine, before = 0, peak = 0;
+
+  if (cfg->eventlog[0] != '\0' || cfg->replay[0] != '\0' || cfg->trace > 0) {
+    printf("a run on several threads cannot be traced, logged or replayed; use --threads 1\n");
+    exit(EXIT_FAILURE);
+  }
+  sim->net = sim;
+  reset(sim);
+  sh.net = sim;
+  sh.nshards = n;
+  sh.shard = calloc(n, sizeof(struct simulation *));
+  w = calloc(n, sizeof(struct worker));
+  tid = calloc(n, sizeof(pthread_t));
+  if (sh.shard == NULL || w == NULL || tid == NULL) {
+    printf("memory allocation for shards failed.");
+    exit(EXIT_FAILURE);
+  }
+  for (s = 0; s < n; s++) {
+    mine = (cfg->flows - s + n - 1) / n;
+    shard = sim_create();
+    shard->cfg = *cfg;
+    shard->cfg.flows = mine;
+    shard->cfg.threads = 1;
+    shard->cfg.nsimmax = (int)((long)cfg->nsimmax * (before + mine) / cfg->flows -
+                               (long)cfg->nsimmax * before / cfg->flows);
+    shard->cfg.lambda = cfg->lambda * cfg->flows / mine;
+    shard->cfg.seed = cfg->seed + 1 + s;
+    before += mine;
+    shard->proto = sim->proto;
+    shard->net = sim;
+    init(shard);
+    for (i = 0; i < mine; i++)
+      shard->conns[i].id = s + i * n;
+    start_entities(shard);
+    sh.shard[s] = shard;
+    w[s].sh = &sh;
+    w[s].index = s;
+  }
+
+  pthread_mutex_init(&sh.barrier.lock, NULL);
+  pthread_cond_init(&sh.barrier.cond, NULL);
+  sh.barrier.count = n;
+  sh.barrier.waiting = sh.barrier.round = 0;
+  exchange(&sh);
+  for (s = 1; s < n; s++)
+    if (pthread_create(&tid[s], NULL, shard_worker, &w[s]) != 0) {
+      printf("cannot start worker thread\n");
+      exit(EXIT_FAILURE);
+    }
+  shard_worker(&w[0]);          /* this thread runs shard 0 */
+  for (s = 1; s < n; s++)
+    pthread_join(tid[s], NULL);
+  pthread_cond_destroy(&sh.barrier.cond);
+  pthread_mutex_destroy(&sh.barrier.lock);
+
+  /* gather the connections back into sim */
+  for (s = 0; s < n; s++) {
+    shard = sh.shard[s];
+    for (i = 0; i < shard->nconns; i++) {
+      from = &shard->conns[i];
+      to = &sim->conns[from->id];
+      to->stats = from->stats;
+      to->latency = from->latency;
+      to->inflight_area = from->inflight_area;
+      sim->inflight_area += from->inflight_area;
+    }
+    sim->nsim += shard->nsim;
+    if (shard->time > sim->time)
+      sim->time = shard->time;
+    peak += shard->evlist.peak;   /* the shards' peaks need not coincide */
+    sim_destroy(shard);
+  }
+  free(sh.shard);
+  free(w);
+  free(tid);
+  results(sim, peak);
+}
+#endif
+
+/********************* SIMULATION OBJECT *******************/
+
+struct simulation *sim_create(void)
+{
+  struct simulation *sim;
+
+  sim = calloc(1, sizeof(struct simulation));
+  if (sim == NULL) {
+    printf("memory allocation for simulation failed.");
+    exit(EXIT_FAILURE);
+  }
+  sim->cfg = default_config;
+  sim->current = &sim->stats;
+  sim->net = sim;
+  evq_init(&sim->evlist);
+  return sim;
+}
+
+void sim_destroy(struct simulation *sim)
+{
+  free_connections(sim);
+  evq_free(&sim->evlist);
+  free(sim->outbox);
+  channel_free(&sim->link[A]);
+  channel_free(&sim->link[B]);
+#if TRACE_MODE == TRACE_BINARY
+  free(sim->tracering);
+#endif
+  free(sim);
+}
+
+void sim_run(struct simulation *sim)
+{
+  struct ckpt ck;
+  double from = 0.0;
+  int threads, reseed = 0;
+
+  evq_free(&sim->evlist);       /* events left over from an earlier run */
+  /* a new run starts from fresh protocol state: an earlier one may even */
+  /* have been of another protocol                                       */
+  free_connections(sim);
+  if (sim->cfg.restore[0] != '\0') {
+    ckpt_open(&ck, sim->cfg.restore);
+    reseed = restore_config(sim, &ck);
+  }
+  sim->proto = protocols[sim->cfg.protocol];
+  settle_config(sim);
+  threads = sim->cfg.threads < sim->cfg.flows ? sim->cfg.threads : sim->cfg.flows;
+#if SIM_THREADS
+  if (threads > 1) {
+    shards(sim, threads);
+    return;
+  }
+#else
+  if (threads > 1)
+    printf("Warning: built with SIM_THREADS 0, so the connections run on one thread\n");
+#endif
+  sim->net = sim;
+  startlog(sim);
+  if (sim->cfg.restore[0] != '\0') {
+    from = restore_state(sim, &ck, reseed);
+    ckpt_close(&ck);
+  }
+  else {
+    init(sim);
+    start_entities(sim);
+  }
+  run_from(sim, from);
+  results(sim, sim->evlist.peak);
+  endtrace(sim);
+  endlog(sim);
+}
+
+const struct sim_config *sim_config(const struct simulation *sim)
+{
+  return &sim->cfg;
+}
+
+struct sim_stats *sim_stats(struct simulation *sim)
+{
+  return sim->current;
+}
+
+void *sim_protocol(const struct simulation *sim)
+{
+  return sim->conn != NULL ? sim->conn->protocol : NULL;
+}
+
+void sim_set_protocol(struct simulation *sim, void *state, void (*release)(void *))
+{
+  struct connection *c = sim->conn;
+
+  if (c == NULL) {              /* not in a run: there is nothing to keep it */
+    if (state != NULL && release != NULL)
+      release(state);
+    return;
+  }
+  if (c->protocol != NULL && c->release_protocol != NULL)
+    c->release_protocol(c->protocol);
+  c->protocol = state;
+  c->release_protocol = release;
+}
+
+float get_sim_time(struct simulation *sim)
+{
+  return sim->time;
+}
+
+#ifndef EMULATOR_NO_MAIN
+/* the packets resent for each message that got through */
+static double resend_ratio(const struct sim_stats *st)
+{
+  return st->messages_delivered > 0 ? (double)st->packets_resent / st->messages_delivered : 0.0;
+}
+
+static void report(struct simulation *sim)
+{
+  const struct sim_stats *st = &sim->stats;
+  int i;
+
+  printf(" Simulator terminated at time %f\n after attempting to send %d msgs from layer5\n",st->sim_time,st->nsim);
+  printf("number of messages dropped due to full window:  %d \n", st->window_full);
+  if (st->msgs_queued > 0)
+    printf("number of messages queued at A:  %d (average wait %f, peak queue %d) \n",
+           st->msgs_queued, st->queue_delay / st->msgs_queued, st->peak_queue);
+  printf("number of valid (not corrupt or duplicate) acknowledgements received at A:  %d \n", st->new_ACKs);
   printf("(note: a single acknowledgement may have acknowledged more than one packet - if cumulative acknowledgements are used)\n");
-  printf("number of packet resends by A:  %d \n", packets_resent);
-  printf("number of correct packets received at B:  %d \n", packets_received);
-  printf("number of messages delivered to application:  %d \n", messages_delivered);
-  return EXIT_SUCCESS;
+  printf("number of packet resends by A:  %d \n", st->packets_resent);
+  if (st->fast_retransmits > 0)
+    printf("number of those that were fast retransmits:  %d \n", st->fast_retransmits);
+  printf("number of correct packets received at B:  %d \n", st->packets_received);
+  printf("number of messages delivered to application:  %d \n", st->messages_delivered);
+  if (st->peak_batch > 1)
+    printf("messages per hand-over to the application:  mean %f, most %d \n",
+           (double)st->messages_delivered / st->deliveries, st->peak_batch);
+  if (st->current_RTO > 0.0)
+    printf("retransmission timeout at A:  %f (smoothed RTT %f) \n", st->current_RTO, st->smoothed_RTT);
+  if (st->cwnd > 0.0)
+    printf("congestion window at A:  %f \n", st->cwnd);
+  if (st->ndropped > 0)
+    printf("number of packets dropped by a full link buffer:  %d \n", st->ndropped);
+  printf("number of events simulated:  %d \n", st->nevents);
+  printf("peak number of events held by the emulator:  %d \n", st->peak_events);
+  printf("goodput:  %f messages delivered per time unit \n", st->goodput);
+  printf("throughput:  %f bytes delivered per time unit \n", st->throughput);
+  printf("delivery latency:  mean %f, p50 %f, p95 %f, p99 %f, max %f \n", st->latency_mean,
+         st->latency_p50, st->latency_p95, st->latency_p99, st->latency_max);
+  printf("retransmission overhead:  %f resends per message delivered \n", resend_ratio(st));
+  printf("average number of packets in the medium:  %f \n", st->avg_inflight);
+  for (i = 0; sim->nconns > 1 && i < sim->nconns; i++) {
+    st = &sim->conns[i].stats;
+    printf("connection %d:  %d msgs from layer5, %d delivered, %d resends, goodput %f, latency mean %f, p99 %f \n",
+           i, st->nsim, st->messages_delivered, st->packets_resent, st->goodput, st->latency_mean,
+           st->latency_p99);
+  }
 }
-float get_sim_time(void) {
-    return time;
+
+/* the statistics as one JSON object */
+static void report_json(struct simulation *sim, FILE *f)
+{
+  const struct sim_stats *st = &sim->stats;
+  int i;
+
+  fprintf(f, "{\n");
+  fprintf(f, "  \"sim_time\": %f,\n", st->sim_time);
+  fprintf(f, "  \"msgs_sent\": %d,\n", st->nsim);
+  fprintf(f, "  \"window_full\": %d,\n", st->window_full);
+  fprintf(f, "  \"msgs_queued\": %d,\n", st->msgs_queued);
+  fprintf(f, "  \"queue_delay\": %f,\n", st->queue_delay);
+  fprintf(f, "  \"peak_queue\": %d,\n", st->peak_queue);
+  fprintf(f, "  \"total_ACKs_received\": %d,\n", st->total_ACKs_received);
+  fprintf(f, "  \"new_ACKs\": %d,\n", st->new_ACKs);
+  fprintf(f, "  \"packets_resent\": %d,\n", st->packets_resent);
+  fprintf(f, "  \"fast_retransmits\": %d,\n", st->fast_retransmits);
+  fprintf(f, "  \"packets_received\": %d,\n", st->packets_received);
+  fprintf(f, "  \"messages_delivered\": %d,\n", st->messages_delivered);
+  fprintf(f, "  \"bytes_delivered\": %ld,\n", st->bytes_delivered);
+  fprintf(f, "  \"deliveries\": %d,\n", st->deliveries);
+  fprintf(f, "  \"peak_batch\": %d,\n", st->peak_batch);
+  fprintf(f, "  \"smoothed_RTT\": %f,\n", st->smoothed_RTT);
+  fprintf(f, "  \"rto\": %f,\n", st->current_RTO);
+  fprintf(f, "  \"cwnd\": %f,\n", st->cwnd);
+  fprintf(f, "  \"tolayer3\": %d,\n", st->ntolayer3);
+  fprintf(f, "  \"lost\": %d,\n", st->nlost);
+  fprintf(f, "  \"dropped\": %d,\n", st->ndropped);
+  fprintf(f, "  \"corrupt\": %d,\n", st->ncorrupt);
+  fprintf(f, "  \"events\": %d,\n", st->nevents);
+  fprintf(f, "  \"peak_events\": %d,\n", st->peak_events);
+  fprintf(f, "  \"goodput\": %f,\n", st->goodput);
+  fprintf(f, "  \"throughput\": %f,\n", st->throughput);
+  fprintf(f, "  \"latency\": { \"mean\": %f, \"p50\": %f, \"p95\": %f, \"p99\": %f, \"max\": %f },\n",
+          st->latency_mean, st->latency_p50, st->latency_p95, st->latency_p99, st->latency_max);
+  fprintf(f, "  \"resends_per_message\": %f,\n", resend_ratio(st));
+  fprintf(f, "  \"avg_inflight\": %f%s\n", st->avg_inflight, sim->nconns > 1 ? "," : "");
+  if (sim->nconns > 1) {
+    fprintf(f, "  \"connections\": [\n");
+    for (i = 0; i < sim->nconns; i++) {
+      st = &sim->conns[i].stats;
+      fprintf(f, "    { \"msgs_sent\": %d, \"messages_delivered\": %d, \"packets_resent\": %d, "
+              "\"goodput\": %f, \"latency_mean\": %f, \"latency_p99\": %f, \"avg_inflight\": %f }%s\n",
+              st->nsim, st->messages_delivered, st->packets_resent, st->goodput, st->latency_mean,
+              st->latency_p99, st->avg_inflight, i + 1 < sim->nconns ? "," : "");
+    }
+    fprintf(f, "  ]\n");
+  }
+  fprintf(f, "}\n");
+}
+
+static void write_json(struct simulation *sim)
+{
+  const char *path = sim->cfg.json;
+  FILE *f;
+
+  if (strcmp(path, "-") == 0) {
+    report_json(sim, stdout);
+    return;
+  }
+  f = fopen(path, "w");
+  if (f == NULL) {
+    printf("cannot write statistics to %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  report_json(sim, f);
+  fclose(f);
+}
+
+int main(int argc, char **argv)
+{
+  struct simulation *sim = sim_create();
+
+  sim_parse_args(sim, argc, argv);
+  printf("-----  Stop and Wait Network Simulator Version 1.1 -------- \n\n");
+  sim_run(sim);
+  report(sim);
+  if (sim->cfg.json[0] != '\0')
+    write_json(sim);
+  sim_destroy(sim);
+  return EXIT_SUCCESS;
 }
+#endif
@@ -1,11 +1,143 @@
-extern int TRACE;
+#ifndef EMULATOR_H
+#define EMULATOR_H
 
-/* statistics updated by GBN */
-extern int total_ACKs_received;
-extern int packets_resent;       /* count of the number of packets resent  */
-extern int new_ACKs;      /* count of the number of acks correctly received */
-extern int packets_received;  /* count of the packets received by receiver */
-extern int window_full; /* count of the number of messages dropped due to full window */
+/* all the state of one simulation: event list, clock, random numbers, */
+/* statistics and the protocol entities.  Its layout is private to the  */
+/* emulator; several can exist, and run, side by side in one process.  */
+struct simulation;
+
+#define SIM_PATHMAX 128     /* room for a file name setting */
+
+#define SIM_RNG_XOSHIRO 0   /* --rng xoshiro: a fast generator, a stream per decision */
+#define SIM_RNG_RAND    1   /* --rng rand: the rand() sequence of old */
+
+/* the largest packet payload and layer 5 message a build can carry; */
+/* --mtu and --msgsize choose sizes up to these.  Traces show the    */
+/* first 20 bytes of a payload, so neither may be less than that     */
+#ifndef MAXPAYLOAD
+#define MAXPAYLOAD 20
+#endif
+#ifndef MAXMSG
+#define MAXMSG 20
+#endif
+#if MAXPAYLOAD < 20 || MAXMSG < 20
+#error "MAXPAYLOAD and MAXMSG must be at least 20"
+#endif
+
+#define SIM_PROTOCOL_SR  0  /* --protocol sr: Selective Repeat (sr.c) */
+#define SIM_PROTOCOL_GBN 1  /* --protocol gbn: Go-Back-N (gbn.c) */
+
+#define SIM_CHANNEL_CLASSIC 0   /* --channel classic: 1 to 10 after the last arrival */
+#define SIM_CHANNEL_LINK    1   /* --channel link: bandwidth, buffer, bursts (channel.h) */
+
+/* --delay: the propagation delay distributions of --channel link */
+#define SIM_DELAY_UNIFORM     0
+#define SIM_DELAY_CONSTANT    1
+#define SIM_DELAY_EXPONENTIAL 2
+#define SIM_DELAY_PARETO      3
+
+/* run parameters of a simulation, set with sim_setting()/sim_parse_args() */
+struct sim_config {
+  int nsimmax;              /* number of msgs to generate, then stop */
+  float lossprob;           /* probability that a packet is dropped */
+  float corruptprob;        /* probability that one bit is packet is flipped */
+  int corruptdirection;     /* A->B A<-B or bidirectional corruption/loss */
+  float lambda;             /* arrival rate of messages from layer 5 */
+  int trace;                /* trace level */
+  unsigned int seed;        /* seed of the random number generator */
+  int rng;                  /* SIM_RNG_XOSHIRO or SIM_RNG_RAND (see rng.h) */
+  int protocol;             /* SIM_PROTOCOL_SR or SIM_PROTOCOL_GBN */
+  int windowsize;           /* protocol window size, 0 = protocol default */
+  int seqspace;             /* protocol sequence space, 0 = protocol default */
+  int queuesize;            /* messages the sender may queue while its window is full */
+  int mtu;                  /* largest payload of a packet, at most MAXPAYLOAD */
+  int msgsize;              /* bytes in each message from layer 5, at most MAXMSG */
+  int flows;                /* connections between A and B sharing the medium */
+  int threads;              /* worker threads a run of several connections may use */
+  int channel;              /* SIM_CHANNEL_CLASSIC or SIM_CHANNEL_LINK; the rest */
+                            /* of these are settings of the link                 */
+  float bandwidth;          /* bytes sent per time unit, 0 = no limit */
+  int buffer;               /* packets held waiting to be sent, 0 = no limit */
+  float goodbad;            /* Gilbert-Elliott: chance the good state turns bad */
+  float badgood;            /* ... and the bad state good, per packet */
+  float badloss;            /* loss probability in the bad state (lossprob in the good) */
+  int delay;                /* SIM_DELAY_... propagation delay distribution */
+  float delaymean;          /* ... and its mean, at least 1 */
+  char tracefile[SIM_PATHMAX]; /* where a binary trace build writes its trace */
+  char eventlog[SIM_PATHMAX];  /* file to log events to (see evlog.h), "" for none */
+  char replay[SIM_PATHMAX];    /* event log to replay arrivals and channel from, "" for none */
+  char json[SIM_PATHMAX];      /* file sr's main() writes the statistics to as JSON, "-" for stdout */
+  char checkpoint[SIM_PATHMAX]; /* file to write checkpoints of the run to (see checkpoint.h), "" for none */
+  float interval;              /* simulated time between checkpoints */
+  char restore[SIM_PATHMAX];   /* checkpoint to carry a run on from, "" to start afresh */
+};
+
+/* statistics of a simulation: the first group is updated by the protocol */
+/* entities, the rest by the emulator                                     */
+struct sim_stats {
+  int window_full;          /* count of the number of messages dropped due to full window */
+  int total_ACKs_received;
+  int packets_resent;       /* count of the number of packets resent  */
+  int fast_retransmits;     /* of those, resent early on the evidence of later ACKs */
+  int new_ACKs;             /* count of the number of acks correctly received */
+  int packets_received;     /* count of the packets received by receiver */
+  int msgs_queued;          /* messages that waited in the sender's queue */
+  double queue_delay;       /* total time they waited there */
+  int peak_queue;           /* peak number of messages waiting at once */
+  double smoothed_RTT;      /* sender's smoothed round trip time estimate, 0 if none */
+  double current_RTO;       /* sender's retransmission timeout, 0 if fixed */
+  double cwnd;              /* sender's congestion window, 0 if it has none */
+
+  float sim_time;           /* time the last event was simulated */
+  int nsim;                 /* messages passed from layer 5 to layer 4 */
+  int messages_delivered;   /* messages passed up to layer 5 */
+  long bytes_delivered;     /* the bytes of data in them */
+  int deliveries;           /* calls of tolayer5() and tolayer5_batch() that did so */
+  int peak_batch;           /* most messages passed up by one of them */
+  int ntolayer3;            /* packets handed to layer 3 */
+  int nlost;                /* packets lost by the medium */
+  int ndropped;             /* of those, dropped by a full link buffer */
+  int ncorrupt;             /* packets corrupted by the medium */
+  int nevents;              /* events simulated */
+  int peak_events;          /* peak number of events in the emulator */
+
+  /* figures of merit, worked out at the end of the run */
+  double goodput;           /* messages delivered per unit of simulated time */
+  double throughput;        /* bytes delivered per unit of simulated time */
+  double latency_mean;      /* time from handing a message to layer 4 to its */
+  double latency_p50;       /* delivery at the other side; the percentiles  */
+  double latency_p95;       /* come from a histogram and are within 1/32    */
+  double latency_p99;
+  double latency_max;
+  double avg_inflight;      /* packets in the medium, averaged over time */
+};
+
+/* create a simulation with default settings, and free one */
+extern struct simulation *sim_create(void);
+extern void sim_destroy(struct simulation *);
+
+/* apply --name value arguments and --config files, as sr's main() does */
+extern void sim_parse_args(struct simulation *, int argc, char **argv);
+
+/* set a run parameter by its command line name, 0 if name or value is bad */
+extern int sim_setting(struct simulation *, const char *name, const char *value);
+
+/* run the simulation from time 0 with the current settings, prompting on */
+/* stdin for any of msgs, loss, corrupt, direction, lambda and trace that */
+/* were not set.  May be called again to rerun; stats are reset each time */
+extern void sim_run(struct simulation *);
+
+/* the run parameters and statistics of a simulation.  While a run is */
+/* going the statistics are those of the connection being simulated,  */
+/* which its entities update; after it, the totals of all of them     */
+extern const struct sim_config *sim_config(const struct simulation *);
+extern struct sim_stats *sim_stats(struct simulation *);
+
+/* state of the protocol entities of the connection being simulated.  */
+/* sim_destroy(), the next run and a later call to sim_set_protocol()  */
+/* release it with the function given (if any)                         */
+extern void *sim_protocol(const struct simulation *);
+extern void sim_set_protocol(struct simulation *, void *state, void (*release)(void *));
 
 #define   A    0
 #define   B    1
@@ -14,27 +146,59 @@ extern int window_full; /* count of the number of messages dropped due to full w
 /* 4 (students' code).  It contains the data (characters) to be delivered */
 /* to layer 5 via the students transport level protocol entities.         */
 struct msg {
-  char data[20];
+  int length;               /* bytes of data in use */
+  char data[MAXMSG];
 };
 
 /* a packet is the data unit passed from layer 4 (students code) to layer */
 /* 3 (teachers code).  Note the pre-defined packet structure, which all   */
-/* students must follow. */
+/* students must follow.  A message larger than the MTU is carried by   */
+/* several packets; all but the last of them have more set.              */
 struct pkt {
   int seqnum;
   int acknum;
   int checksum;
-  char payload[20];
+  int length;               /* bytes of payload in use, at most the MTU */
+  int more;                 /* nonzero if more segments of the message follow */
+  int conn;                 /* connection, filled in by the emulator (see --flows) */
+  char payload[MAXPAYLOAD];
 };
 
+/* Each routine below takes the simulation it acts on as its first      */
+/* argument; the entity routines are passed it in turn (see protocol.h) */
+
 /* send to A or B (int), packet to send */
-extern void tolayer3(int, struct pkt);  
+extern void tolayer3(struct simulation *, int, struct pkt);
+
+/* a packet buffer from the emulator's pool, to build a packet in */
+extern struct pkt *pkt_alloc(struct simulation *);
 
-/* deliver to A or B (int), data to deliver */
-extern void tolayer5(int, char[20]); 
+/* send to A or B (int) the packet built in a buffer from pkt_alloc(); */
+/* the buffer goes through the medium as it is and belongs to the      */
+/* emulator from now on, so the sender must not touch it again         */
+extern void tolayer3_pkt(struct simulation *, int, struct pkt *);
+
+/* deliver to A or B (int), data to deliver and its length in bytes */
+extern void tolayer5(struct simulation *, int, const char *, int);
+
+/* deliver to A or B (int) the payloads of count (int) packets, in order, */
+/* each of them a whole message, as one hand-over                          */
+extern void tolayer5_batch(struct simulation *, int, const struct pkt *, int);
 
 /* start timer at A or B (int), increment */
-extern void starttimer(int, double);       
+extern void starttimer(struct simulation *, int, double);
 
 /* stop timer at A or B (int) */
-extern void stoptimer(int);               
+extern void stoptimer(struct simulation *, int);
+
+/* start timer id (int >= 0) at A or B (int), increment; when it goes  */
+/* off, A_timerinterrupt_id(id) or B_timerinterrupt_id(id) is called    */
+extern void starttimer_id(struct simulation *, int, int, double);
+
+/* stop timer id (int) at A or B (int) */
+extern void stoptimer_id(struct simulation *, int, int);
+
+/* current simulated time */
+extern float get_sim_time(struct simulation *);
+
+#endif
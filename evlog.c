@@ -0,0 +1,123 @@
+/* ******************************************************************
+   Writing, reading and printing of binary event logs (see evlog.h).
+**********************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "evlog.h"
+
+#define EVLOG_BUFRECS 4096      /* records buffered before a write */
+
+static void make_header(struct evlog_header *h)
+{
+  memset(h, 0, sizeof(*h));
+  memcpy(h->magic, EVLOG_MAGIC, sizeof(EVLOG_MAGIC));
+  h->recsize = sizeof(struct evlog_rec);
+}
+
+int evlog_open(struct evlog_writer *w, const char *path)
+{
+  struct evlog_header h;
+
+  w->n = 0;
+  w->buf = malloc(EVLOG_BUFRECS * sizeof(struct evlog_rec));
+  w->fp = fopen(path, "wb");
+  if (w->buf == NULL || w->fp == NULL) {
+    free(w->buf);
+    if (w->fp != NULL)
+      fclose(w->fp);
+    w->fp = NULL;
+    w->buf = NULL;
+    return 0;
+  }
+  make_header(&h);
+  fwrite(&h, sizeof(h), 1, w->fp);
+  return 1;
+}
+
+static void flush(struct evlog_writer *w)
+{
+  if (w->n > 0 && fwrite(w->buf, sizeof(struct evlog_rec), w->n, w->fp) != (size_t)w->n) {
+    printf("cannot write event log\n");
+    exit(EXIT_FAILURE);
+  }
+  w->n = 0;
+}
+
+void evlog_put(struct evlog_writer *w, const struct evlog_rec *r)
+{
+  if (w->n == EVLOG_BUFRECS)
+    flush(w);
+  w->buf[w->n++] = *r;
+}
+
+void evlog_close(struct evlog_writer *w)
+{
+  flush(w);
+  fclose(w->fp);
+  free(w->buf);
+  w->fp = NULL;
+  w->buf = NULL;
+}
+
+int evlog_load(struct evlog *log, const char *path)
+{
+  struct evlog_header h, want;
+  FILE *f;
+  long size;
+
+  log->rec = NULL;
+  log->n = 0;
+  f = fopen(path, "rb");
+  if (f == NULL)
+    return 0;
+  make_header(&want);
+  if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(&h, &want, sizeof(h)) != 0 ||
+      fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) < 0) {
+    fclose(f);
+    return 0;
+  }
+  log->n = (size - (long)sizeof(h)) / (long)sizeof(struct evlog_rec);
+  log->rec = malloc((log->n > 0 ? log->n : 1) * sizeof(struct evlog_rec));
+  if (log->rec == NULL || fseek(f, (long)sizeof(h), SEEK_SET) != 0 ||
+      fread(log->rec, sizeof(struct evlog_rec), log->n, f) != (size_t)log->n) {
+    fclose(f);
+    evlog_free(log);
+    return 0;
+  }
+  fclose(f);
+  return 1;
+}
+
+void evlog_free(struct evlog *log)
+{
+  free(log->rec);
+  log->rec = NULL;
+  log->n = 0;
+}
+
+void evlog_print(FILE *f, const struct evlog_rec *r)
+{
+  static const char *const kinds[] = { "timer", "layer5", "layer3", "send" };
+  static const char *const fates[] = { "delivered", "lost", "corrupt-data", "corrupt-seq", "corrupt-ack",
+                                       "dropped" };
+  const char *entity = r->entity == 0 ? "A" : "B";
+
+  fprintf(f, "%f %s %s", r->time, r->kind < 4 ? kinds[r->kind] : "?", entity);
+  switch (r->kind) {
+  case EVL_TIMER:
+    fprintf(f, " timer %d", r->timerid);
+    break;
+  case EVL_LAYER3:
+    fprintf(f, " seq %d ack %d %s", r->seqnum, r->acknum, r->fate < 6 ? fates[r->fate] : "?");
+    break;
+  case EVL_SEND:
+    fprintf(f, " seq %d ack %d %s", r->seqnum, r->acknum, r->fate < 6 ? fates[r->fate] : "?");
+    if (r->fate != EVL_LOST && r->fate != EVL_DROPPED)
+      fprintf(f, " delay %f", 1 + 9 * r->delaydraw);
+    break;
+  }
+  if (r->conn != 0)
+    fprintf(f, " conn %d", r->conn);
+  fprintf(f, "\n");
+}
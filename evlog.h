@@ -0,0 +1,86 @@
+/* ******************************************************************
+   Binary event log of a simulation run.
+
+   With --eventlog file the emulator records, in order, every event it
+   takes off the event list, and every decision the channel makes about
+   a packet handed to layer 3: lost, corrupted (and how), and how long
+   it spends in the medium.  File layout: a struct evlog_header, then
+   struct evlog_recs, native byte order.  evlogdump prints one as text.
+
+   A log can also be read back with --replay file: the emulator then
+   takes the message arrivals and the channel's decisions, in order, from
+   the log instead of drawing them at random, so a different protocol
+   (or version of one) sees exactly the same traffic and loss pattern.
+**********************************************************************/
+#ifndef EVLOG_H
+#define EVLOG_H
+
+#include <stdio.h>
+
+/* kind of record */
+#define EVL_TIMER    0          /* a timer went off */
+#define EVL_LAYER5   1          /* a message arrived from layer 5 */
+#define EVL_LAYER3   2          /* a packet arrived from layer 3 */
+#define EVL_SEND     3          /* a packet was handed to layer 3 */
+
+/* what the channel did to a packet (fate of EVL_SEND and EVL_LAYER3) */
+#define EVL_DELIVERED      0
+#define EVL_LOST           1
+#define EVL_CORRUPT_DATA   2    /* payload[0] overwritten */
+#define EVL_CORRUPT_SEQ    3    /* seqnum overwritten */
+#define EVL_CORRUPT_ACK    4    /* acknum overwritten */
+#define EVL_DROPPED        5    /* lost: the link's buffer was full (--channel link) */
+
+struct evlog_rec {
+  double delaydraw;             /* EVL_SEND: the draw u in [0,1] that made its time in the */
+                                /* medium, after the packets ahead of it, 1 + 9u (for     */
+                                /* --channel link, see channel_delay())                   */
+  float time;                   /* simulated time of the event */
+  int seqnum, acknum;           /* packet header as sent or as received */
+  int timerid;                  /* EVL_TIMER: timer id, -1 for the single timer */
+  unsigned char kind;           /* EVL_... kind */
+  unsigned char entity;         /* A or B: where the event happened, or who sent */
+  unsigned char fate;           /* EVL_DELIVERED ... EVL_DROPPED */
+  unsigned char unused;
+  int conn;                     /* connection of the entity (see --flows), in what was */
+                                /* padding, so older logs read back as connection 0   */
+};
+
+struct evlog_header {
+  char magic[8];                /* EVLOG_MAGIC */
+  unsigned int recsize;         /* sizeof(struct evlog_rec) */
+  unsigned int unused;
+};
+
+#define EVLOG_MAGIC "SIMEVL1"
+
+/* buffered writer of a log */
+struct evlog_writer {
+  FILE *fp;
+  struct evlog_rec *buf;
+  int n;                        /* records in buf */
+};
+
+/* a log read back into memory for replay */
+struct evlog {
+  struct evlog_rec *rec;
+  long n;
+};
+
+/* create file and write the header; 0 if it can't be created */
+extern int evlog_open(struct evlog_writer *w, const char *path);
+
+/* append r, writing the buffer out when it is full */
+extern void evlog_put(struct evlog_writer *w, const struct evlog_rec *r);
+
+/* write out what is buffered and close the file */
+extern void evlog_close(struct evlog_writer *w);
+
+/* read the whole log in path; 0 if it can't be read or isn't a log */
+extern int evlog_load(struct evlog *log, const char *path);
+extern void evlog_free(struct evlog *log);
+
+/* print r as one line of text */
+extern void evlog_print(FILE *f, const struct evlog_rec *r);
+
+#endif
@@ -0,0 +1,31 @@
+/* ******************************************************************
+   Print a binary event log (see evlog.h) as text, one line per event:
+
+     time kind entity [timer id | seq n ack n fate [delay d]]
+
+   usage: evlogdump file
+
+   Build with: gcc -o evlogdump evlogdump.c evlog.c
+**********************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include "evlog.h"
+
+int main(int argc, char **argv)
+{
+  struct evlog log;
+  long i;
+
+  if (argc != 2) {
+    printf("usage: %s file\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  if (!evlog_load(&log, argv[1])) {
+    printf("cannot read event log %s\n", argv[1]);
+    exit(EXIT_FAILURE);
+  }
+  for (i = 0; i < log.n; i++)
+    evlog_print(stdout, &log.rec[i]);
+  evlog_free(&log);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,192 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "evqueue.h"
+
+/* ******************************************************************
+   4-ary min-heap of events.  A wider node halves the tree depth
+   compared to a binary heap, and the four children of a node sit next
+   to each other in memory, so sift-down touches fewer cache lines.
+   Every event records its own heap slot, which lets evq_remove() take
+   an arbitrary event out in O(log n) without searching for it.
+**********************************************************************/
+
+#define ARITY 4
+#define INITIAL_CAPACITY 64
+#define SLAB_EVENTS 256
+
+struct evslab {
+  struct evslab *next;
+  struct event events[SLAB_EVENTS];
+};
+
+/* true if event a must be simulated before event b */
+static int before(const struct event *a, const struct event *b)
+{
+  if (a->evtime != b->evtime)
+    return a->evtime < b->evtime;
+  return a->evseq > b->evseq;   /* newest first, as the sorted list did */
+}
+
+static void place(struct evqueue *q, int i, struct event *p)
+{
+  q->heap[i] = p;
+  p->heapidx = i;
+}
+
+static void siftup(struct evqueue *q, int i, struct event *p)
+{
+  int parent;
+
+  while (i > 0) {
+    parent = (i - 1) / ARITY;
+    if (!before(p, q->heap[parent]))
+      break;
+    place(q, i, q->heap[parent]);
+    i = parent;
+  }
+  place(q, i, p);
+}
+
+static void siftdown(struct evqueue *q, int i, struct event *p)
+{
+  int child, last, best, c;
+
+  for (;;) {
+    child = i * ARITY + 1;
+    if (child >= q->size)
+      break;
+    last = child + ARITY;
+    if (last > q->size)
+      last = q->size;
+    best = child;
+    for (c = child + 1; c < last; c++)
+      if (before(q->heap[c], q->heap[best]))
+        best = c;
+    if (!before(q->heap[best], p))
+      break;
+    place(q, i, q->heap[best]);
+    i = best;
+  }
+  place(q, i, p);
+}
+
+void evq_init(struct evqueue *q)
+{
+  q->heap = NULL;
+  q->size = 0;
+  q->capacity = 0;
+  q->nextseq = 0;
+  q->slabs = NULL;
+  q->freelist = NULL;
+  q->inuse = 0;
+  q->peak = 0;
+}
+
+/* releases the heap and every event node, queued or not */
+void evq_free(struct evqueue *q)
+{
+  struct evslab *slab;
+
+  while (q->slabs != NULL) {
+    slab = q->slabs;
+    q->slabs = slab->next;
+    free(slab);
+  }
+  free(q->heap);
+  evq_init(q);
+}
+
+struct event *evq_alloc(struct evqueue *q)
+{
+  struct evslab *slab;
+  struct event *p;
+  int i;
+
+  if (q->freelist == NULL) {
+    slab = malloc(sizeof(struct evslab));
+    if (slab == NULL) {
+      printf("memory allocation for event failed.");
+      exit(EXIT_FAILURE);
+    }
+    slab->next = q->slabs;
+    q->slabs = slab;
+    for (i = SLAB_EVENTS - 1; i >= 0; i--) {
+      slab->events[i].nextfree = q->freelist;
+      q->freelist = &slab->events[i];
+    }
+  }
+  p = q->freelist;
+  q->freelist = p->nextfree;
+  p->heapidx = -1;
+  if (++q->inuse > q->peak)
+    q->peak = q->inuse;
+  return p;
+}
+
+void evq_release(struct evqueue *q, struct event *p)
+{
+  p->nextfree = q->freelist;
+  q->freelist = p;
+  q->inuse--;
+}
+
+static void grow(struct evqueue *q)
+{
+  struct event **grown;
+  int newcap;
+
+  if (q->size == q->capacity) {
+    newcap = q->capacity ? q->capacity * 2 : INITIAL_CAPACITY;
+    grown = realloc(q->heap, newcap * sizeof(struct event *));
+    if (grown == NULL) {
+      printf("memory allocation for event queue failed.");
+      exit(EXIT_FAILURE);
+    }
+    q->heap = grown;
+    q->capacity = newcap;
+  }
+}
+
+void evq_push(struct evqueue *q, struct event *p)
+{
+  grow(q);
+  p->evseq = q->nextseq++;
+  siftup(q, q->size++, p);
+}
+
+void evq_restore(struct evqueue *q, struct event *p)
+{
+  grow(q);
+  siftup(q, q->size++, p);
+}
+
+struct event *evq_pop(struct evqueue *q)
+{
+  struct event *top;
+
+  if (q->size == 0)
+    return NULL;
+  top = q->heap[0];
+  if (--q->size > 0)
+    siftdown(q, 0, q->heap[q->size]);
+  top->heapidx = -1;
+  return top;
+}
+
+void evq_remove(struct evqueue *q, struct event *p)
+{
+  struct event *moved;
+  int i = p->heapidx;
+
+  if (i < 0)
+    return;
+  p->heapidx = -1;
+  if (--q->size == i)
+    return;
+  /* refill the hole with the last leaf, which may belong above or below */
+  moved = q->heap[q->size];
+  if (i > 0 && before(moved, q->heap[(i - 1) / ARITY]))
+    siftup(q, i, moved);
+  else
+    siftdown(q, i, moved);
+}
@@ -0,0 +1,59 @@
+/* ******************************************************************
+   Future event set for the network emulator.
+
+   Events are kept in an implicit 4-ary min-heap ordered on evtime.  An
+   event scheduled for the same time as one already queued is popped
+   first, which is exactly the order the original sorted event list
+   produced (it inserted a new event in front of any equal-time events).
+   Keeping that order means runs stay bit-for-bit reproducible.
+
+   The queue also owns the memory for its events: evq_alloc() hands out
+   nodes carved from slabs and evq_release() puts them on a free list,
+   so a long simulation stops calling malloc once it reaches its peak.
+**********************************************************************/
+#ifndef EVQUEUE_H
+#define EVQUEUE_H
+
+#include "emulator.h"
+
+struct event {
+  float evtime;           /* event time */
+  int evtype;             /* event type code */
+  int eventity;           /* entity where event occurs */
+  int evconn;             /* connection of that entity (see --flows) */
+  struct pkt pkt;         /* packet (if any) assoc w/ this event */
+  int evtimerid;          /* which timer of eventity, for timer events */
+  int evfate;             /* what the channel did to pkt, EVL_DELIVERED... */
+  unsigned long evseq;    /* insertion order, used to break ties on evtime */
+  int heapidx;            /* slot in the heap, -1 when not queued */
+  struct event *nextfree; /* free list link while the node is unused */
+};
+
+struct evslab;
+
+struct evqueue {
+  struct event **heap;    /* heap[0] is the next event to simulate */
+  int size;               /* number of queued events */
+  int capacity;           /* allocated slots in heap */
+  unsigned long nextseq;  /* evseq given to the next inserted event */
+  struct evslab *slabs;   /* every block of event nodes allocated */
+  struct event *freelist; /* released nodes ready for reuse */
+  int inuse;              /* nodes handed out and not yet released */
+  int peak;               /* highest value inuse has reached */
+};
+
+extern void evq_init(struct evqueue *q);
+extern void evq_free(struct evqueue *q);
+extern void evq_push(struct evqueue *q, struct event *p);
+/* queue p with the evseq it has, for the events of a checkpoint; */
+/* q->nextseq must already be past it                             */
+extern void evq_restore(struct evqueue *q, struct event *p);
+extern struct event *evq_pop(struct evqueue *q);
+extern void evq_remove(struct evqueue *q, struct event *p);
+extern struct event *evq_alloc(struct evqueue *q);
+extern void evq_release(struct evqueue *q, struct event *p);
+
+/* next event to simulate, NULL if the queue is empty */
+#define evq_peek(q)  ((q)->size > 0 ? (q)->heap[0] : (struct event *)NULL)
+
+#endif
@@ -1,7 +1,11 @@
 #include <stdlib.h>
 #include <stdio.h>
-#include <stdbool.h>
+#include <string.h>
 #include "emulator.h"
+#include "trace.h"
+#include "checksum.h"
+#include "sendq.h"
+#include "checkpoint.h"
 #include "gbn.h"
 
 /* ******************************************************************
@@ -20,89 +24,154 @@
    - removed bidirectional GBN code and other code not used by prac.
    - fixed C style to adhere to current programming style
    - added GBN implementation
+   - packets are protected by the CRC-32C of checksum.c instead of a sum
+   - messages that find the window full wait in a --queue of them
+   - the entry points are static, reached through gbn_protocol, so GBN
+   and SR can be linked into one binary and chosen with --protocol
+   - packets are built in place and sent with tolayer3_pkt(), and
+   arriving ones are read where the emulator holds them
+   - packets carry the length of their payload; GBN does not segment,
+   so a message must fit the --mtu
+   - checkpoint() writes the state of both entities to a --checkpoint
+   and reads it back for --restore
 **********************************************************************/
 
 #define RTT  16.0       /* round trip time.  MUST BE SET TO 16.0 when submitting assignment */
-#define WINDOWSIZE 6    /* the maximum number of buffered unacked packet
+#define WINDOWSIZE 6    /* default maximum number of buffered unacked packet
                           MUST BE SET TO 6 when submitting assignment */
-#define SEQSPACE 7      /* the min sequence space for GBN must be at least windowsize + 1 */
+#define SEQSPACE 7      /* default sequence space; for GBN it must be at least windowsize + 1 */
 #define NOTINUSE (-1)   /* used to fill header fields that are not being used */
 
-/* generic procedure to compute the checksum of a packet.  Used by both sender and receiver
-   the simulator will overwrite part of your packet with 'z's.  It will not overwrite your
-   original checksum.  This procedure must generate a different checksum to the original if
-   the packet is corrupted.
-*/
-int ComputeChecksum(struct pkt packet)
+
+/* all the state of the sender and receiver of one simulation */
+struct gbn_state {
+  /* window and sequence space in use, chosen at run time (see gbn_configure) */
+  int windowsize;
+  int seqspace;
+  int winmask;                   /* windowsize - 1 if a power of two, else 0 */
+  int seqmask;                   /* seqspace - 1 if a power of two, else 0 */
+
+  /* sender */
+  struct pkt *buffer;            /* array for storing packets waiting for ACK */
+  int windowfirst, windowlast;   /* array indexes of the first/last packet awaiting ACK */
+  int windowcount;               /* the number of packets currently awaiting an ACK */
+  int A_nextseqnum;              /* the next sequence number to be used by the sender */
+  struct sendq queue;            /* messages waiting for the window to open */
+
+  /* receiver */
+  int expectedseqnum;            /* the sequence number expected next by the receiver */
+  int B_nextseqnum;              /* the sequence number for the next packets sent by B */
+};
+
+/* x modulo the window / the sequence space, for x >= 0 */
+#define WIN(g, x) ((g)->winmask ? (x) & (g)->winmask : (x) % (g)->windowsize)
+#define SEQ(g, x) ((g)->seqmask ? (x) & (g)->seqmask : (x) % (g)->seqspace)
+
+static void release_state(void *p)
 {
-  int checksum = 0;
-  int i;
+  struct gbn_state *g = p;
 
-  checksum = packet.seqnum;
-  checksum += packet.acknum;
-  for ( i=0; i<20; i++ )
-    checksum += (int)(packet.payload[i]);
+  free(g->buffer);
+  sendq_free(&g->queue);
+  free(g);
+}
 
-  return checksum;
+/* the protocol state of sim, created on first use */
+static struct gbn_state *state(struct simulation *sim)
+{
+  struct gbn_state *g = sim_protocol(sim);
+
+  if (g == NULL) {
+    g = calloc(1, sizeof(struct gbn_state));
+    if (g == NULL) {
+      printf("memory allocation for protocol state failed.");
+      exit(EXIT_FAILURE);
+    }
+    sim_set_protocol(sim, g, release_state);
+  }
+  return g;
 }
 
-bool IsCorrupted(struct pkt packet)
+/* pick up the window and sequence space requested from the emulator and
+   check them: GBN needs seqspace >= windowsize + 1 */
+static void gbn_configure(struct simulation *sim, struct gbn_state *g)
 {
-  if (packet.checksum == ComputeChecksum(packet))
-    return (false);
-  else
-    return (true);
+  const struct sim_config *cfg = sim_config(sim);
+
+  g->windowsize = cfg->windowsize > 0 ? cfg->windowsize : WINDOWSIZE;
+  g->seqspace = cfg->seqspace > 0 ? cfg->seqspace : SEQSPACE;
+  if (cfg->seqspace <= 0 && g->seqspace < g->windowsize + 1)
+    g->seqspace = g->windowsize + 1;
+  if (g->seqspace < g->windowsize + 1) {
+    printf("Go-Back-N needs a sequence space of at least the window + 1 (%d), not %d\n",
+           g->windowsize + 1, g->seqspace);
+    exit(EXIT_FAILURE);
+  }
+  g->winmask = (g->windowsize & (g->windowsize - 1)) == 0 ? g->windowsize - 1 : 0;
+  g->seqmask = (g->seqspace & (g->seqspace - 1)) == 0 ? g->seqspace - 1 : 0;
+  if (cfg->msgsize > cfg->mtu) {
+    printf("Go-Back-N sends each message in one packet: %d bytes do not fit the MTU of %d\n",
+           cfg->msgsize, cfg->mtu);
+    exit(EXIT_FAILURE);
+  }
 }
 
 
 /********* Sender (A) variables and functions ************/
 
-static struct pkt buffer[WINDOWSIZE];  /* array for storing packets waiting for ACK */
-static int windowfirst, windowlast;    /* array indexes of the first/last packet awaiting ACK */
-static int windowcount;                /* the number of packets currently awaiting an ACK */
-static int A_nextseqnum;               /* the next sequence number to be used by the sender */
 
-/* called from layer 5 (application layer), passed the message to be sent to other side */
-void A_output(struct msg message)
+/* send a copy of packet, which stays in the window buffer for resends */
+static void send_copy(struct simulation *sim, const struct pkt *packet)
 {
-  struct pkt sendpkt;
-  int i;
+  struct pkt *copy = pkt_alloc(sim);
 
-  /* if not blocked waiting on ACK */
-  if ( windowcount < WINDOWSIZE) {
-    if (TRACE > 1)
-      printf("----A: New message arrives, send window is not full, send new messge to layer3!\n");
-
-    /* create packet */
-    sendpkt.seqnum = A_nextseqnum;
-    sendpkt.acknum = NOTINUSE;
-    for ( i=0; i<20 ; i++ )
-      sendpkt.payload[i] = message.data[i];
-    sendpkt.checksum = ComputeChecksum(sendpkt);
-
-    /* put packet in window buffer */
-    /* windowlast will always be 0 for alternating bit; but not for GoBackN */
-    windowlast = (windowlast + 1) % WINDOWSIZE;
-    buffer[windowlast] = sendpkt;
-    windowcount++;
-
-    /* send out packet */
-    if (TRACE > 0)
-      printf("Sending packet %d to layer 3\n", sendpkt.seqnum);
-    tolayer3 (A, sendpkt);
-
-    /* start timer if first packet in window */
-    if (windowcount == 1)
-      starttimer(A,RTT);
-
-    /* get next sequence number, wrap back to 0 */
-    A_nextseqnum = (A_nextseqnum + 1) % SEQSPACE;
-  }
-  /* if blocked,  window is full */
-  else {
-    if (TRACE > 0)
-      printf("----A: New message arrives, send window is full\n");
-    window_full++;
+  *copy = *packet;
+  tolayer3_pkt(sim, A, copy);
+}
+
+/* send message as the next packet of the window, which must have room */
+static void send_message(struct simulation *sim, struct gbn_state *g, const struct msg *message)
+{
+  struct pkt *sendpkt;
+
+  TRACE_EVENT(sim, GBN_A_SEND);
+
+  /* create packet, in its place in the window buffer */
+  /* windowlast will always be 0 for alternating bit; but not for GoBackN */
+  g->windowlast = WIN(g, g->windowlast + 1);
+  sendpkt = &g->buffer[g->windowlast];
+  sendpkt->seqnum = g->A_nextseqnum;
+  sendpkt->acknum = NOTINUSE;
+  sendpkt->length = message->length;
+  sendpkt->more = 0;
+  memcpy(sendpkt->payload, message->data, message->length);
+  sendpkt->checksum = pkt_checksum(sendpkt);
+  g->windowcount++;
+
+  /* send out packet */
+  TRACE_EVENT(sim, GBN_A_SENDING, sendpkt->seqnum);
+  send_copy(sim, sendpkt);
+
+  /* start timer if first packet in window */
+  if (g->windowcount == 1)
+    starttimer(sim, A,RTT);
+
+  /* get next sequence number, wrap back to 0 */
+  g->A_nextseqnum = SEQ(g, g->A_nextseqnum + 1);
+}
+
+/* called from layer 5 (application layer), passed the message to be sent to other side */
+static void A_output(struct simulation *sim, struct msg message)
+{
+  struct gbn_state *g = state(sim);
+
+  /* if not blocked waiting on ACK, and no older message is waiting */
+  if (g->windowcount < g->windowsize && g->queue.count == 0)
+    send_message(sim, g, &message);
+  /* if blocked,  window is full: queue it, if there is room */
+  else if (!sendq_put(sim, &g->queue, &message)) {
+    TRACE_EVENT(sim, GBN_A_FULL);
+    sim_stats(sim)->window_full++;
   }
 }
 
@@ -110,154 +179,171 @@ void A_output(struct msg message)
 /* called from layer 3, when a packet arrives for layer 4
    In this practical this will always be an ACK as B never sends data.
 */
-void A_input(struct pkt packet)
+static void A_input(struct simulation *sim, const struct pkt *packet)
 {
+  struct gbn_state *g = state(sim);
+  struct msg message;
   int ackcount = 0;
   int i;
 
   /* if received ACK is not corrupted */
-  if (!IsCorrupted(packet)) {
-    if (TRACE > 0)
-      printf("----A: uncorrupted ACK %d is received\n",packet.acknum);
-    total_ACKs_received++;
+  if (!pkt_corrupted(packet)) {
+    TRACE_EVENT(sim, GBN_A_ACK, packet->acknum);
+    sim_stats(sim)->total_ACKs_received++;
 
     /* check if new ACK or duplicate */
-    if (windowcount != 0) {
-          int seqfirst = buffer[windowfirst].seqnum;
-          int seqlast = buffer[windowlast].seqnum;
+    if (g->windowcount != 0) {
+          int seqfirst = g->buffer[g->windowfirst].seqnum;
+          int seqlast = g->buffer[g->windowlast].seqnum;
           /* check case when seqnum has and hasn't wrapped */
-          if (((seqfirst <= seqlast) && (packet.acknum >= seqfirst && packet.acknum <= seqlast)) ||
-              ((seqfirst > seqlast) && (packet.acknum >= seqfirst || packet.acknum <= seqlast))) {
+          if (((seqfirst <= seqlast) && (packet->acknum >= seqfirst && packet->acknum <= seqlast)) ||
+              ((seqfirst > seqlast) && (packet->acknum >= seqfirst || packet->acknum <= seqlast))) {
 
             /* packet is a new ACK */
-            if (TRACE > 0)
-              printf("----A: ACK %d is not a duplicate\n",packet.acknum);
-            new_ACKs++;
+            TRACE_EVENT(sim, GBN_A_NEWACK, packet->acknum);
+            sim_stats(sim)->new_ACKs++;
 
             /* cumulative acknowledgement - determine how many packets are ACKed */
-            if (packet.acknum >= seqfirst)
-              ackcount = packet.acknum + 1 - seqfirst;
+            if (packet->acknum >= seqfirst)
+              ackcount = packet->acknum + 1 - seqfirst;
             else
-              ackcount = SEQSPACE - seqfirst + packet.acknum;
+              ackcount = g->seqspace - seqfirst + packet->acknum;
 
 	    /* slide window by the number of packets ACKed */
-            windowfirst = (windowfirst + ackcount) % WINDOWSIZE;
+            g->windowfirst = WIN(g, g->windowfirst + ackcount);
 
             /* delete the acked packets from window buffer */
             for (i=0; i<ackcount; i++)
-              windowcount--;
+              g->windowcount--;
 
 	    /* start timer again if there are still more unacked packets in window */
-            stoptimer(A);
-            if (windowcount > 0)
-              starttimer(A, RTT);
+            stoptimer(sim, A);
+            if (g->windowcount > 0)
+              starttimer(sim, A, RTT);
+
+            /* send what has been waiting for the window to open */
+            while (g->windowcount < g->windowsize && sendq_get(sim, &g->queue, &message))
+              send_message(sim, g, &message);
 
           }
         }
         else
-          if (TRACE > 0)
-        printf ("----A: duplicate ACK received, do nothing!\n");
+          TRACE_EVENT(sim, GBN_A_DUPACK);
   }
   else
-    if (TRACE > 0)
-      printf ("----A: corrupted ACK is received, do nothing!\n");
+    TRACE_EVENT(sim, GBN_A_BADACK);
 }
 
 /* called when A's timer goes off */
-void A_timerinterrupt(void)
+static void A_timerinterrupt(struct simulation *sim)
 {
+  struct gbn_state *g = state(sim);
   int i;
 
-  if (TRACE > 0)
-    printf("----A: time out,resend packets!\n");
+  TRACE_EVENT(sim, GBN_A_TIMEOUT);
 
-  for(i=0; i<windowcount; i++) {
+  for(i=0; i<g->windowcount; i++) {
 
-    if (TRACE > 0)
-      printf ("---A: resending packet %d\n", (buffer[(windowfirst+i) % WINDOWSIZE]).seqnum);
+    TRACE_EVENT(sim, GBN_A_RESEND, (g->buffer[WIN(g, g->windowfirst+i)]).seqnum);
 
-    tolayer3(A,buffer[(windowfirst+i) % WINDOWSIZE]);
-    packets_resent++;
-    if (i==0) starttimer(A,RTT);
+    send_copy(sim, &g->buffer[WIN(g, g->windowfirst+i)]);
+    sim_stats(sim)->packets_resent++;
+    if (i==0) starttimer(sim, A,RTT);
   }
 }
 
 
 
+/* the window buffer and message queue of A */
+static void new_window(struct simulation *sim, struct gbn_state *g)
+{
+  free(g->buffer);
+  g->buffer = malloc(g->windowsize * sizeof(struct pkt));
+  if (g->buffer == NULL) {
+    printf("memory allocation for window failed.");
+    exit(EXIT_FAILURE);
+  }
+  sendq_init(&g->queue, sim_config(sim)->queuesize);
+}
+
 /* the following routine will be called once (only) before any other */
 /* entity A routines are called. You can use it to do any initialization */
-void A_init(void)
+static void A_init(struct simulation *sim)
 {
+  struct gbn_state *g = state(sim);
+
+  gbn_configure(sim, g);
+  new_window(sim, g);
+
   /* initialise A's window, buffer and sequence number */
-  A_nextseqnum = 0;  /* A starts with seq num 0, do not change this */
-  windowfirst = 0;
-  windowlast = -1;   /* windowlast is where the last packet sent is stored.
+  g->A_nextseqnum = 0;  /* A starts with seq num 0, do not change this */
+  g->windowfirst = 0;
+  g->windowlast = -1;   /* windowlast is where the last packet sent is stored.
 		     new packets are placed in winlast + 1
 		     so initially this is set to -1
 		   */
-  windowcount = 0;
+  g->windowcount = 0;
 }
 
 
 
 /********* Receiver (B)  variables and procedures ************/
 
-static int expectedseqnum; /* the sequence number expected next by the receiver */
-static int B_nextseqnum;   /* the sequence number for the next packets sent by B */
-
 
 /* called from layer 3, when a packet arrives for layer 4 at B*/
-void B_input(struct pkt packet)
+static void B_input(struct simulation *sim, const struct pkt *packet)
 {
-  struct pkt sendpkt;
-  int i;
+  struct gbn_state *g = state(sim);
+  struct pkt *sendpkt = pkt_alloc(sim);   /* the ACK is not kept, so build it in place */
 
   /* if not corrupted and received packet is in order */
-  if  ( (!IsCorrupted(packet))  && (packet.seqnum == expectedseqnum) ) {
-    if (TRACE > 0)
-      printf("----B: packet %d is correctly received, send ACK!\n",packet.seqnum);
-    packets_received++;
+  if  ( (!pkt_corrupted(packet))  && (packet->seqnum == g->expectedseqnum) ) {
+    TRACE_EVENT(sim, GBN_B_RECEIVED, packet->seqnum);
+    sim_stats(sim)->packets_received++;
 
     /* deliver to receiving application */
-    tolayer5(B, packet.payload);
+    tolayer5(sim, B, packet->payload, packet->length);
 
     /* send an ACK for the received packet */
-    sendpkt.acknum = expectedseqnum;
+    sendpkt->acknum = g->expectedseqnum;
 
     /* update state variables */
-    expectedseqnum = (expectedseqnum + 1) % SEQSPACE;
+    g->expectedseqnum = SEQ(g, g->expectedseqnum + 1);
   }
   else {
     /* packet is corrupted or out of order resend last ACK */
-    if (TRACE > 0)
-      printf("----B: packet corrupted or not expected sequence number, resend ACK!\n");
-    if (expectedseqnum == 0)
-      sendpkt.acknum = SEQSPACE - 1;
+    TRACE_EVENT(sim, GBN_B_REACK);
+    if (g->expectedseqnum == 0)
+      sendpkt->acknum = g->seqspace - 1;
     else
-      sendpkt.acknum = expectedseqnum - 1;
+      sendpkt->acknum = g->expectedseqnum - 1;
   }
 
   /* create packet */
-  sendpkt.seqnum = B_nextseqnum;
-  B_nextseqnum = (B_nextseqnum + 1) % 2;
+  sendpkt->seqnum = g->B_nextseqnum;
+  g->B_nextseqnum = (g->B_nextseqnum + 1) % 2;
 
   /* we don't have any data to send.  fill payload with 0's */
-  for ( i=0; i<20 ; i++ )
-    sendpkt.payload[i] = '0';
+  sendpkt->length = 0;
+  sendpkt->more = 0;
+  memset(sendpkt->payload, '0', sizeof(sendpkt->payload));
 
   /* computer checksum */
-  sendpkt.checksum = ComputeChecksum(sendpkt);
+  sendpkt->checksum = pkt_checksum(sendpkt);
 
   /* send out packet */
-  tolayer3 (B, sendpkt);
+  tolayer3_pkt(sim, B, sendpkt);
 }
 
 /* the following routine will be called once (only) before any other */
 /* entity B routines are called. You can use it to do any initialization */
-void B_init(void)
+static void B_init(struct simulation *sim)
 {
-  expectedseqnum = 0;
-  B_nextseqnum = 1;
+  struct gbn_state *g = state(sim);
+
+  gbn_configure(sim, g);
+  g->expectedseqnum = 0;
+  g->B_nextseqnum = 1;
 }
 
 /******************************************************************************
@@ -265,11 +351,53 @@ void B_init(void)
  *****************************************************************************/
 
 /* Note that with simplex transfer from a-to-B, there is no B_output() */
-void B_output(struct msg message)
+static void B_output(struct simulation *sim, struct msg message)
 {
+  (void)sim;
+  (void)message;
 }
 
 /* called when B's timer goes off */
-void B_timerinterrupt(void)
+static void B_timerinterrupt(struct simulation *sim)
 {
+  (void)sim;
 }
+
+/* GBN runs a single timer per entity, so numbered timers are never started */
+static void A_timerinterrupt_id(struct simulation *sim, int id)
+{
+  (void)sim;
+  (void)id;
+}
+
+static void B_timerinterrupt_id(struct simulation *sim, int id)
+{
+  (void)sim;
+  (void)id;
+}
+
+/* both entities to or from a checkpoint */
+static void checkpoint(struct simulation *sim, struct ckpt *ck)
+{
+  struct gbn_state *g = state(sim);
+
+  if (ck->reading) {
+    gbn_configure(sim, g);
+    new_window(sim, g);
+  }
+  ckpt_io(ck, g->buffer, g->windowsize * sizeof(struct pkt));
+  CKPT_IO(ck, g->windowfirst);
+  CKPT_IO(ck, g->windowlast);
+  CKPT_IO(ck, g->windowcount);
+  CKPT_IO(ck, g->A_nextseqnum);
+  sendq_io(ck, &g->queue);
+  CKPT_IO(ck, g->expectedseqnum);
+  CKPT_IO(ck, g->B_nextseqnum);
+}
+
+const struct protocol gbn_protocol = {
+  0,                            /* simplex */
+  A_output, A_input, A_timerinterrupt, A_timerinterrupt_id, A_init,
+  B_output, B_input, B_timerinterrupt, B_timerinterrupt_id, B_init,
+  checkpoint
+};
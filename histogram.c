@@ -0,0 +1,86 @@
+/* ******************************************************************
+   Log-linear histogram: every power of two from 2^HIST_MINEXP on is
+   split into HIST_SUB equal buckets, so however many values go in and
+   however far they spread, the memory is fixed and a quantile is off
+   by at most half a bucket, 1/32 of its value.
+**********************************************************************/
+#include <string.h>
+#include "histogram.h"
+
+void hist_init(struct histogram *h)
+{
+  memset(h, 0, sizeof(*h));
+}
+
+/* lower bound of the values in octave o, without needing libm */
+static double octave_base(int o)
+{
+  double base = 1.0 / (1 << -HIST_MINEXP);
+
+  while (o-- > 0)
+    base *= 2;
+  return base;
+}
+
+/* the bucket value falls in */
+static int bucket_of(double value)
+{
+  double base = 1.0 / (1 << -HIST_MINEXP);
+  int o, sub;
+
+  if (value < base)
+    return 0;
+  for (o = 0; o < HIST_OCTAVES && value >= 2 * base; o++)
+    base *= 2;
+  if (o == HIST_OCTAVES)
+    return HIST_BUCKETS - 1;
+  sub = (int)((value / base - 1) * HIST_SUB);
+  return o * HIST_SUB + (sub < HIST_SUB ? sub : HIST_SUB - 1);
+}
+
+/* the middle of bucket b */
+static double bucket_mid(int b)
+{
+  return octave_base(b / HIST_SUB) * (1.0 + (b % HIST_SUB + 0.5) / HIST_SUB);
+}
+
+void hist_add(struct histogram *h, double value)
+{
+  h->bucket[bucket_of(value)]++;
+  h->count++;
+  h->sum += value;
+  if (value > h->max)
+    h->max = value;
+}
+
+void hist_merge(struct histogram *h, const struct histogram *from)
+{
+  int b;
+
+  for (b = 0; b < HIST_BUCKETS; b++)
+    h->bucket[b] += from->bucket[b];
+  h->count += from->count;
+  h->sum += from->sum;
+  if (from->max > h->max)
+    h->max = from->max;
+}
+
+double hist_quantile(const struct histogram *h, double q)
+{
+  double rank, mid;
+  long seen = 0;
+  int b;
+
+  if (h->count == 0)
+    return 0.0;
+  if (q >= 1.0)
+    return h->max;
+  rank = q * h->count;
+  for (b = 0; b < HIST_BUCKETS; b++) {
+    seen += h->bucket[b];
+    if (seen >= rank && seen > 0)
+      break;
+  }
+  mid = bucket_mid(b < HIST_BUCKETS ? b : HIST_BUCKETS - 1);
+  return mid < h->max ? mid : h->max;
+}
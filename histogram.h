@@ -0,0 +1,29 @@
+/* ******************************************************************
+   Constant memory histogram of non-negative values (see histogram.c),
+   for the delivery latency percentiles of a run.
+**********************************************************************/
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#define HIST_SUB     16     /* buckets per power of two: quantiles within 1/32 */
+#define HIST_MINEXP  (-8)   /* values below 2^HIST_MINEXP share the first bucket */
+#define HIST_OCTAVES 48     /* ... and from 2^(HIST_MINEXP + HIST_OCTAVES) the last */
+#define HIST_BUCKETS (HIST_OCTAVES * HIST_SUB)
+
+struct histogram {
+  long count;
+  double sum;
+  double max;
+  unsigned int bucket[HIST_BUCKETS];
+};
+
+extern void hist_init(struct histogram *h);
+extern void hist_add(struct histogram *h, double value);
+
+/* add the values recorded in from to those of h */
+extern void hist_merge(struct histogram *h, const struct histogram *from);
+
+/* the value q (0..1) of the way through the recorded ones, 0 if none */
+extern double hist_quantile(const struct histogram *h, double q);
+
+#endif
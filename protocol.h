@@ -0,0 +1,39 @@
+/* ******************************************************************
+   The entry points of a protocol, through which the emulator drives
+   its two entities.  Each protocol (gbn.c, sr.c) defines one of these
+   and the emulator lists them; --protocol picks the one a run uses.
+   A protocol keeps its state behind sim_protocol(), so any number of
+   simulations, of any protocols, can run side by side.
+**********************************************************************/
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include "emulator.h"
+
+struct ckpt;
+
+struct protocol {
+  int bidirectional;        /* 0 = A->B only, 1 = B_output() takes messages too */
+
+  /* layer 5 has message for A/B to send; a packet has arrived at A/B, */
+  /* valid, where the emulator keeps it, until the input routine returns */
+  void (*A_output)(struct simulation *, struct msg);
+  void (*A_input)(struct simulation *, const struct pkt *);
+  /* the single timer, and numbered timer id, of A/B went off */
+  void (*A_timerinterrupt)(struct simulation *);
+  void (*A_timerinterrupt_id)(struct simulation *, int);
+  /* called once, before any other routine of A/B */
+  void (*A_init)(struct simulation *);
+
+  void (*B_output)(struct simulation *, struct msg);
+  void (*B_input)(struct simulation *, const struct pkt *);
+  void (*B_timerinterrupt)(struct simulation *);
+  void (*B_timerinterrupt_id)(struct simulation *, int);
+  void (*B_init)(struct simulation *);
+
+  /* write the state of both entities to a checkpoint, or read it back */
+  /* (see checkpoint.h), which then stands in for A_init() and B_init() */
+  void (*checkpoint)(struct simulation *, struct ckpt *);
+};
+
+#endif
@@ -0,0 +1,51 @@
+/* ******************************************************************
+   Seeding of the emulator's random number generators (see rng.h).
+**********************************************************************/
+#include "rng.h"
+
+/* splitmix64: turns one 64 bit value into a well mixed sequence */
+static uint64_t splitmix64(uint64_t *x)
+{
+  uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+void rng_seed(struct rng *g, int kind, unsigned int seed)
+{
+  uint64_t x;
+  long word;
+  int i, j;
+
+  g->kind = kind;
+  if (kind == RNG_XOSHIRO) {
+    /* each stream gets its own seed, and the state of each comes from   */
+    /* splitmix64 as the xoshiro authors advise, so none is all zeros    */
+    for (i = 0; i < RNG_NSTREAMS; i++) {
+      x = ((uint64_t)seed << 8) | (uint64_t)i;
+      for (j = 0; j < 4; j++)
+        g->s[i][j] = splitmix64(&x);
+    }
+    return;
+  }
+
+  /* the same initialisation as srand(): a Lehmer sequence, then */
+  /* 310 values discarded so the state is well mixed            */
+  if (seed == 0)
+    seed = 1;
+  g->r[0] = seed;
+  word = (int)seed;
+  for (i = 1; i < RANDDEG; i++) {
+    word = 16807 * (word % 127773) - 2836 * (word / 127773);
+    if (word < 0)
+      word += 2147483647;
+    g->r[i] = (uint32_t)word;
+  }
+  for (i = RANDDEG; i < RANDSIZE; i++)
+    g->r[i] = g->r[i - RANDDEG];
+  g->next = 0;
+  for (i = 0; i < 10 * RANDDEG; i++)
+    (void)rng_uniform(g, 0);
+}
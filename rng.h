@@ -0,0 +1,80 @@
+/* ******************************************************************
+   Random number generators of the emulator.
+
+   Each simulation owns one struct rng.  It provides a separate stream
+   of numbers for each kind of random decision (RNG_ARRIVAL ...), so
+   that changing, say, the loss probability leaves the message arrivals
+   and the delays of the packets alone.
+
+   RNG_XOSHIRO  xoshiro256** (Blackman and Vigna), one generator per
+                stream, each seeded from the run seed by splitmix64.
+                Fast, a period of 2^256 - 1, and the same numbers on
+                every platform.
+   RNG_RAND     the additive feedback generator behind the C library's
+                rand(), as the emulator has always used.  It has a
+                single stream shared by all decisions; it is kept so
+                that old runs can be reproduced exactly.
+**********************************************************************/
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+#define RNG_XOSHIRO 0
+#define RNG_RAND    1
+
+/* streams, one per kind of random decision */
+#define RNG_ARRIVAL  0          /* times (and entities) of messages from layer 5 */
+#define RNG_LOSS     1          /* whether a packet is lost */
+#define RNG_DELAY    2          /* how long a packet is in the medium */
+#define RNG_CORRUPT  3          /* whether, and how, a packet is corrupted */
+#define RNG_CHANNEL  4          /* the burst losses of --channel link */
+#define RNG_NSTREAMS 5
+
+#define RANDDEG  31             /* degree of the rand() generator */
+#define RANDSEP   3             /* separation of its two taps */
+#define RANDSIZE (RANDDEG + RANDSEP)
+#define RANDMAX  2147483647     /* largest value it returns, as RAND_MAX */
+
+struct rng {
+  int kind;                     /* RNG_XOSHIRO or RNG_RAND */
+  uint64_t s[RNG_NSTREAMS][4];  /* xoshiro256** state of each stream */
+  uint32_t r[RANDSIZE];         /* rand(): the last RANDSIZE values, a ring */
+  int next;                     /* rand(): slot of the next value */
+};
+
+/* (re)start generator kind from seed */
+extern void rng_seed(struct rng *g, int kind, unsigned int seed);
+
+static inline uint64_t rng_rotl(uint64_t x, int k)
+{
+  return (x << k) | (x >> (64 - k));
+}
+
+/* next number of stream, uniform in [0,1) (in [0,1] for RNG_RAND) */
+static inline double rng_uniform(struct rng *g, int stream)
+{
+  uint64_t *s, result, t;
+  uint32_t v;
+  int i;
+
+  if (g->kind == RNG_RAND) {
+    i = g->next;
+    v = g->r[(i + RANDSIZE - RANDDEG) % RANDSIZE] + g->r[(i + RANDSIZE - RANDSEP) % RANDSIZE];
+    g->r[i] = v;
+    g->next = (i + 1) % RANDSIZE;
+    return (double)(v >> 1) / RANDMAX;
+  }
+  s = g->s[stream];
+  result = rng_rotl(s[1] * 5, 7) * 9;
+  t = s[1] << 17;
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rng_rotl(s[3], 45);
+  return (double)(result >> 11) * (1.0 / 9007199254740992.0);   /* 53 bits / 2^53 */
+}
+
+#endif
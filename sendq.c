@@ -0,0 +1,82 @@
+/* ******************************************************************
+   Sender side message queue: a fixed ring of --queue messages that
+   hold layer 5 messages while the window is full.  It keeps the
+   queueing statistics of sim_stats (messages queued, their total
+   waiting time and the peak depth) as messages come and go.
+**********************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include "emulator.h"
+#include "trace.h"
+#include "checkpoint.h"
+#include "sendq.h"
+
+void sendq_init(struct sendq *q, int size)
+{
+  free(q->ring);
+  q->ring = NULL;
+  q->size = size > 0 ? size : 0;
+  q->first = 0;
+  q->count = 0;
+  if (q->size > 0) {
+    q->ring = malloc(q->size * sizeof(struct sendq_entry));
+    if (q->ring == NULL) {
+      printf("memory allocation for message queue failed.");
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+void sendq_free(struct sendq *q)
+{
+  free(q->ring);
+  q->ring = NULL;
+  q->size = q->count = 0;
+}
+
+int sendq_put(struct simulation *sim, struct sendq *q, const struct msg *message)
+{
+  struct sim_stats *st = sim_stats(sim);
+  int last;
+
+  if (q->count == q->size)
+    return 0;
+  last = q->first + q->count;
+  if (last >= q->size)
+    last -= q->size;
+  q->ring[last].message = *message;
+  q->ring[last].since = get_sim_time(sim);
+  q->count++;
+  st->msgs_queued++;
+  if (q->count > st->peak_queue)
+    st->peak_queue = q->count;
+  TRACE_EVENT(sim, SENDQ_PUT, q->count);
+  return 1;
+}
+
+int sendq_get(struct simulation *sim, struct sendq *q, struct msg *message)
+{
+  float waited;
+
+  if (q->count == 0)
+    return 0;
+  *message = q->ring[q->first].message;
+  waited = get_sim_time(sim) - q->ring[q->first].since;
+  sim_stats(sim)->queue_delay += waited;
+  if (++q->first == q->size)
+    q->first = 0;
+  q->count--;
+  TRACE_EVENT(sim, SENDQ_GET, waited, q->count);
+  return 1;
+}
+
+void sendq_io(struct ckpt *ck, struct sendq *q)
+{
+  int i;
+
+  if (ck->reading)
+    q->first = 0;
+  q->count = ckpt_count(ck, q->count, q->size);
+  for (i = 0; i < q->count; i++)
+    CKPT_IO(ck, q->ring[(q->first + i) % q->size]);
+}
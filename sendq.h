@@ -0,0 +1,44 @@
+/* ******************************************************************
+   Sender side message queue shared by the protocol entities (see
+   sendq.c).  Messages that arrive from layer 5 while the window is
+   full wait here, instead of being dropped, until it opens again.
+**********************************************************************/
+#ifndef SENDQ_H
+#define SENDQ_H
+
+#include "emulator.h"
+
+struct ckpt;
+
+/* a message waiting for the window, and the time it arrived */
+struct sendq_entry {
+  struct msg message;
+  float since;
+};
+
+/* a bounded ring of waiting messages, oldest first */
+struct sendq {
+  struct sendq_entry *ring;
+  int size;                 /* capacity, 0 = no queue: messages are dropped */
+  int first;                /* index of the oldest message */
+  int count;                /* messages waiting */
+};
+
+/* make q an empty queue of size messages, releasing what it held */
+extern void sendq_init(struct sendq *q, int size);
+extern void sendq_free(struct sendq *q);
+
+/* queue message; 0 if q is full, and the message must be dropped */
+extern int sendq_put(struct simulation *, struct sendq *q, const struct msg *message);
+
+/* take the oldest message out of q into *message; 0 if q is empty */
+extern int sendq_get(struct simulation *, struct sendq *q, struct msg *message);
+
+/* write the messages waiting in q to a checkpoint, or read them back */
+/* into q, made by sendq_init() of the size the writer's was          */
+extern void sendq_io(struct ckpt *ck, struct sendq *q);
+
+/* the oldest message of q, left in it; NULL if q is empty */
+#define sendq_peek(q)  ((q)->count > 0 ? &(q)->ring[(q)->first].message : (const struct msg *)NULL)
+
+#endif
@@ -1,8 +1,13 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
 #include "emulator.h"
-#include "gbn.h"
+#include "trace.h"
+#include "checksum.h"
+#include "sendq.h"
+#include "bitmap.h"
+#include "checkpoint.h"
 #include "sr.h"
 /* ******************************************************************
    Go Back N protocol.  Adapted from J.F.Kurose
@@ -19,281 +24,928 @@
    - removed bidirectional GBN code and other code not used by prac.
    - fixed C style to adhere to current programming style
    - added GBN implementation
+   - packets are protected by the CRC-32C of checksum.c instead of a sum
+   - with SACK set, each ACK is cumulative and also lists, in a bitmap in
+   its payload, the packets B holds beyond the first one missing
+   - with ACK_EVERY > 1, B coalesces the SACKs of in-order packets
+   - with FAST_RETRANSMIT K, A resends base after K ACKs beyond it
+   - messages that find the window full wait in a --queue of them
+   - with CWND set, an AIMD congestion window limits how much of the
+   window A keeps in flight
+   - built with -DBIDIRECTIONAL=1, both entities send and receive: each
+   has a sender and a receiver half, and data packets carry the ACK for
+   the other direction in acknum (NOTINUSE when there is none, as is the
+   seqnum of an ACK-only packet).  The receiver holds an ACK back for up
+   to ACK_DELAY in the hope of data to ride on.  The "A:" and "B:" of
+   the trace messages then stand for the sender and the receiver.
+   - the entry points are static, reached through sr_protocol, so GBN
+   and SR can be linked into one binary and chosen with --protocol
+   - the ACK and packet counts of sim_stats are kept up to date
+   - packets are built in place and sent with tolayer3_pkt(), and
+   arriving ones are read where the emulator holds them
+   - a message larger than the --mtu is sent as consecutive packets,
+   all but the last with more set, and only once the window has room
+   for all of them; the receiver reassembles it before tolayer5()
+   - which packets are out, ACKed and received is kept in bitmaps, so
+   the scans of a window look at 64 sequence numbers at a time
+   - the receiver hands a run of in-order messages to layer 5 in one
+   tolayer5_batch(), straight from its buffer
+   - checkpoint() writes the windows of both entities to a --checkpoint
+   and reads them back for --restore
 **********************************************************************/
 
 #define RTT  16.0       /* round trip time.  MUST BE SET TO 16.0 when submitting assignment */
-#define WINDOWSIZE 6    /* the maximum number of buffered unacked packet
+#define WINDOWSIZE 6    /* default maximum number of buffered unacked packet
                           MUST BE SET TO 6 when submitting assignment */
-#define SEQSPACE 64      /* the min sequence space for GBN must be at least windowsize + 1 */
+#define SEQSPACE 64      /* default sequence space; for SR it must be at least 2 * windowsize */
 #define NOTINUSE (-1)   /* used to fill header fields that are not being used */
+#ifndef ADAPTIVE_RTO
+#define ADAPTIVE_RTO 1  /* 1 = estimate the timeout from measured RTTs (RTT is only
+                           the initial value), 0 = always time out after RTT */
+#endif
+#define MIN_RTO 2.0     /* bounds on the adaptive retransmission timeout */
+#define MAX_RTO 512.0
+#ifndef BIDIRECTIONAL
+#define BIDIRECTIONAL 0 /* 0 = A->B  1 =  A<->B */
+#endif
+#ifndef SACK
+#define SACK 0          /* 1 = ACKs carry B_base and a bitmap of the packets
+                           received after it, 0 = one ACK per packet */
+#endif
+#define SACKBITS (8 * MAXPAYLOAD)  /* packets after B_base a SACK bitmap can cover,
+                                      if the window needs and the MTU allows it */
+#ifndef ACK_EVERY
+#define ACK_EVERY 1     /* with SACK, B holds back the ACK of in-order packets until
+                           ACK_EVERY of them have arrived or ACK_DELAY after the
+                           first; out-of-order packets are ACKed at once.  1 = no delay */
+#endif
+#ifndef ACK_DELAY
+#define ACK_DELAY 2.0
+#endif
+#ifndef FAST_RETRANSMIT
+#define FAST_RETRANSMIT 0  /* K > 0: resend the packet at base as soon as K ACKs for
+                              packets beyond it have arrived, before its timer goes off */
+#endif
+#ifndef CWND
+#define CWND 0          /* 1 = only cwnd packets of the window may be in flight: slow start
+                           from 1, then one more per window of ACKs; halved on a fast
+                           retransmit, back to 1 on a timeout, once per loss event.
+                           0 = the whole window */
+#endif
+#define MIN_SSTHRESH 2.0
+#if ACK_EVERY > 1 && !SACK
+#error "delayed ACKs need SACK: only a cumulative ACK can stand for several packets"
+#endif
+
+/* in-order packets whose ACK the receiver may hold back: ACK_EVERY, or in */
+/* a bidirectional build one, so it can ride on the next data packet out  */
+#define ACK_HOLD (ACK_EVERY > 1 ? ACK_EVERY : BIDIRECTIONAL ? 2 : 1)
+
+
+/********* Sender variables and functions ************/
+
+/* the sending half of an entity: A's, and in a bidirectional build B's */
+struct sr_sender {
+  int entity;                      /* A or B */
+
+  /* per sequence number arrays and bitmaps have seqspace entries */
+  struct pkt *buffer;
+  uint64_t *outstanding;           /* sent and waiting for its ACK */
+  uint64_t *acked;                 /* ACKed, but base has not passed it yet */
+  int base;
+  bool *timer_running;
+  int nextseqnum;
+  float *sendtime;                 /* when each packet was first sent */
+  int *retries;                    /* number of times each packet was resent */
+  double srtt, rttvar;             /* smoothed RTT and its mean deviation */
+  double rto;                      /* current retransmission timeout */
+  bool rtt_measured;               /* false until the first RTT sample */
+  int beyond_base;                 /* ACKs beyond base since it last moved, -1 once
+                                      base has been fast retransmitted */
+  struct sendq queue;              /* messages waiting for the window to open */
+  double cwnd;                     /* congestion window, in packets (with CWND) */
+  double ssthresh;                 /* slow start ends when cwnd reaches this */
+  int recover;                     /* nextseqnum when cwnd was last cut, -1 once base
+                                      has passed it: the losses of the packets sent
+                                      before then do not cut it again */
+};
+
+/* the receiving half of an entity: B's, and in a bidirectional build A's */
+struct sr_receiver {
+  int entity;                      /* A or B */
+
+  struct pkt *buffer;
+  uint64_t *received;              /* bitmap of the packets held in buffer */
+  int base;
+  int unacked;                     /* in-order packets whose ACK is being held back */
+  int ackseq;                      /* without SACK, the packet whose ACK is held */
+  bool timer_running;              /* the delayed ACK timer, the entity's single timer */
+  struct msg partial;              /* the segments of a message delivered so far */
+};
+
+/* all the state of the senders and receivers of one simulation */
+struct sr_state {
+  /* window and sequence space in use, chosen at run time (see sr_configure) */
+  int windowsize;
+  int seqspace;
+  int seqmask;                     /* seqspace - 1 if a power of two, else 0 */
+  int mtu;                         /* largest payload of a packet */
+
+  struct sr_sender snd[2];         /* indexed by entity */
+  struct sr_receiver rcv[2];
+};
 
-/* generic procedure to compute the checksum of a packet.  Used by both sender and receiver
-   the simulator will overwrite part of your packet with 'z's.  It will not overwrite your
-   original checksum.  This procedure must generate a different checksum to the original if
-   the packet is corrupted.
-*/
-int ComputeChecksum(struct pkt packet)
+/* x modulo the sequence space, for x >= 0; a mask when the size allows */
+#define SEQ(sr, x) ((sr)->seqmask ? (x) & (sr)->seqmask : (x) % (sr)->seqspace)
+
+static void release_state(void *p)
 {
-  int checksum = 0;
+  struct sr_state *sr = p;
   int i;
 
-  checksum = packet.seqnum;
-  checksum += packet.acknum;
-  for ( i=0; i<20; i++ )
-    checksum += (int)(packet.payload[i]);
-
-  return checksum;
+  for (i = A; i <= B; i++) {
+    free(sr->snd[i].buffer);
+    free(sr->snd[i].outstanding);
+    free(sr->snd[i].acked);
+    free(sr->snd[i].timer_running);
+    free(sr->snd[i].sendtime);
+    free(sr->snd[i].retries);
+    sendq_free(&sr->snd[i].queue);
+    free(sr->rcv[i].buffer);
+    free(sr->rcv[i].received);
+  }
+  free(sr);
 }
 
-bool IsCorrupted(struct pkt packet)
+/* the protocol state of sim, created on first use */
+static struct sr_state *state(struct simulation *sim)
 {
-  if (packet.checksum == ComputeChecksum(packet))
-    return (false);
-  else
-    return (true);
+  struct sr_state *sr = sim_protocol(sim);
+
+  if (sr == NULL) {
+    sr = calloc(1, sizeof(struct sr_state));
+    if (sr == NULL) {
+      printf("memory allocation for protocol state failed.");
+      exit(EXIT_FAILURE);
+    }
+    sim_set_protocol(sim, sr, release_state);
+  }
+  return sr;
 }
 
+/* allocate a zeroed array of n elements of the given size, replacing *old */
+static void *realloc_window(void *old, int n, size_t size)
+{
+  void *p;
 
-/********* Sender (A) variables and functions ************/
+  free(old);
+  p = calloc(n, size);
+  if (p == NULL) {
+    printf("memory allocation for window failed.");
+    exit(EXIT_FAILURE);
+  }
+  return p;
+}
 
-enum PacketStatus {
-  NOT_SENT,
-  SENT_NOT_ACKED,
-  ACKED
-};
+/* pick up the window and sequence space requested from the emulator and
+   check them: SR needs seqspace >= 2 * windowsize so a new packet can never
+   be mistaken for a retransmission of one from the previous window */
+static void sr_configure(struct simulation *sim, struct sr_state *sr)
+{
+  const struct sim_config *cfg = sim_config(sim);
+
+  sr->windowsize = cfg->windowsize > 0 ? cfg->windowsize : WINDOWSIZE;
+  sr->seqspace = cfg->seqspace > 0 ? cfg->seqspace : SEQSPACE;
+  if (cfg->seqspace <= 0 && sr->seqspace < 2 * sr->windowsize)
+    sr->seqspace = 2 * sr->windowsize;
+  if (sr->seqspace < 2 * sr->windowsize) {
+    printf("Selective Repeat needs a sequence space of at least twice the window (%d), not %d\n",
+           2 * sr->windowsize, sr->seqspace);
+    exit(EXIT_FAILURE);
+  }
+  sr->seqmask = (sr->seqspace & (sr->seqspace - 1)) == 0 ? sr->seqspace - 1 : 0;
+  /* a message is only sent once the window has room for all of it */
+  sr->mtu = cfg->mtu;
+  if ((cfg->msgsize + sr->mtu - 1) / sr->mtu > sr->windowsize) {
+    printf("a message of %d bytes takes %d packets of the %d byte MTU, more than the window of %d\n",
+           cfg->msgsize, (cfg->msgsize + sr->mtu - 1) / sr->mtu, sr->mtu, sr->windowsize);
+    exit(EXIT_FAILURE);
+  }
+}
 
-static struct pkt buffer[SEQSPACE];
-static enum PacketStatus status[SEQSPACE];
-static int base = 0;   
-static bool timer_running[SEQSPACE];              
-static int nextseqnum = 0;   
-static struct pkt B_buffer[SEQSPACE];
-static int B_received[SEQSPACE];  
-static int B_base = 0;
+/* Jacobson/Karels RTT estimator, fed one round trip time sample */
+static void update_rto(struct simulation *sim, struct sr_sender *s, double sample)
+{
+  double err;
 
-/* called from layer 5 (application layer), passed the message to be sent to other side */
-void A_output(struct msg message)
+  if (!s->rtt_measured) {
+    s->srtt = sample;
+    s->rttvar = sample / 2;
+    s->rtt_measured = true;
+  }
+  else {
+    err = sample - s->srtt;
+    s->srtt += err / 8;                                     /* alpha = 1/8 */
+    s->rttvar += ((err < 0 ? -err : err) - s->rttvar) / 4;  /* beta = 1/4 */
+  }
+  s->rto = s->srtt + 4 * s->rttvar;
+  if (s->rto < MIN_RTO)
+    s->rto = MIN_RTO;
+  if (s->rto > MAX_RTO)
+    s->rto = MAX_RTO;
+
+  /* the statistics describe A's sender */
+  if (s->entity == A) {
+    sim_stats(sim)->smoothed_RTT = s->srtt;
+    sim_stats(sim)->current_RTO = s->rto;
+  }
+}
+
+/* timeout for packet seq: the RTO doubled for every time it was resent */
+static double packet_timeout(const struct sr_sender *s, int seq)
 {
-  struct pkt sendpkt;
+  double timeout;
   int i;
 
-  /* if not blocked waiting on ACK */
-  if ((nextseqnum + SEQSPACE - base) % SEQSPACE < WINDOWSIZE) {
-    if (TRACE > 1)
-      printf("----A: New message arrives, send window is not full, send new messge to layer3!\n");
-
-    /* create packet */
-    sendpkt.seqnum = nextseqnum;
-    sendpkt.acknum = NOTINUSE;
-    for ( i=0; i<20 ; i++ )
-      sendpkt.payload[i] = message.data[i];
-    sendpkt.checksum = ComputeChecksum(sendpkt);
-
-    /* put packet in window buffer */
-    /* windowlast will always be 0 for alternating bit; but not for GoBackN */
-    buffer[nextseqnum] = sendpkt;
-    status[nextseqnum] = SENT_NOT_ACKED;
-
-
-    /* send out packet */
-    if (TRACE > 0)
-      printf("Sending packet %d to layer 3\n", sendpkt.seqnum);
-    tolayer3 (A, sendpkt);
-	if (!timer_running[nextseqnum]) {
-    timer_running[nextseqnum] = true;
-    
-	}
-	starttimer(A, RTT);
-    nextseqnum = (nextseqnum + 1) % SEQSPACE;
-  }else {
-    if (TRACE > 0)
-      printf("----A: New message arrives, send window is full\n");
-    window_full++;
+  if (!ADAPTIVE_RTO)
+    return RTT;
+  timeout = s->rto;
+  for (i = 0; i < s->retries[seq] && timeout < MAX_RTO; i++)
+    timeout *= 2;
+  return timeout < MAX_RTO ? timeout : MAX_RTO;
+}
+
+/* record that packet seq has been ACKed; 1 if that is news */
+static int mark_acked(struct simulation *sim, struct sr_state *sr, struct sr_sender *s, int seq)
+{
+  /* only a packet inside the window can be waiting for its ACK */
+  if (SEQ(sr, seq + sr->seqspace - s->base) >= sr->windowsize ||
+      !bm_test(s->outstanding, seq))
+    return 0;
+  TRACE_EVENT(sim, SR_A_ACKED, seq);
+  bm_clear(s->outstanding, seq);
+  bm_set(s->acked, seq);
+  /* Karn's rule: the ACK of a resent packet is ambiguous, don't sample it */
+  if (ADAPTIVE_RTO && s->retries[seq] == 0)
+    update_rto(sim, s, get_sim_time(sim) - s->sendtime[seq]);
+  if (s->timer_running[seq]) {
+    stoptimer_id(sim, s->entity, seq);
+    s->timer_running[seq] = false;
   }
+  return 1;
 }
 
+/* whether a packet of the window after base has been ACKed */
+static bool acked_beyond_base(const struct sr_state *sr, const struct sr_sender *s)
+{
+  int n = sr->windowsize - 1;
 
-/* called from layer 3, when a packet arrives for layer 4
-   In this practical this will always be an ACK as B never sends data.
-*/
-void A_input(struct pkt packet)
+  return bm_find(s->acked, sr->seqspace, SEQ(sr, s->base + 1), n, 1) < n;
+}
+
+/* grow the congestion window for newacks packets ACKed: by one each in */
+/* slow start, then by one for a whole window of them                  */
+static void open_cwnd(struct simulation *sim, struct sr_state *sr, struct sr_sender *s, int newacks)
+{
+  for (; newacks > 0 && s->cwnd < sr->windowsize; newacks--)
+    s->cwnd += s->cwnd < s->ssthresh ? 1.0 : 1.0 / s->cwnd;
+  if (s->cwnd > sr->windowsize)
+    s->cwnd = sr->windowsize;
+  if (s->entity == A)
+    sim_stats(sim)->cwnd = s->cwnd;
+}
+
+/* a loss of packet seq: remember half the window as the slow start */
+/* threshold and restart from cwnd packets, ssthresh if cwnd is 0.   */
+/* A loss event cuts it once, however many of its packets are lost   */
+static void cut_cwnd(struct simulation *sim, struct sr_state *sr, struct sr_sender *s, int seq,
+                     double cwnd)
 {
-   int acknum;
-   int has_unacked;
-   int i;
-   acknum = packet.acknum;
-   if (packet.checksum != ComputeChecksum(packet)) {
-    if (TRACE > 0)
-      printf("----A: uncorrupted ACK %d is received\n",packet.acknum);
+  if (s->recover >= 0 &&
+      SEQ(sr, seq + sr->seqspace - s->base) < SEQ(sr, s->recover + sr->seqspace - s->base))
     return;
+  s->recover = s->nextseqnum;
+  s->ssthresh = s->cwnd / 2 > MIN_SSTHRESH ? s->cwnd / 2 : MIN_SSTHRESH;
+  s->cwnd = cwnd > 0 ? cwnd : s->ssthresh;
+  TRACE_EVENT(sim, SR_A_CWND, s->cwnd, s->ssthresh);
+  if (s->entity == A)
+    sim_stats(sim)->cwnd = s->cwnd;
+}
+
+/* the held back ACK is on its way: nothing is owed to the peer any more */
+static void ack_sent(struct simulation *sim, struct sr_receiver *r)
+{
+  r->unacked = 0;
+  if (r->timer_running) {
+    stoptimer(sim, r->entity);
+    r->timer_running = false;
   }
-  
-  status[acknum] = ACKED;
-  timer_running[acknum] = false;
-   
-  if (TRACE > 0)
-    printf("----A: ACK %d is not a duplicate\n",packet.acknum);
-
-  if ((acknum < base && base - acknum > SEQSPACE / 2) ||  
-      (acknum >= base && acknum < (base + WINDOWSIZE) % SEQSPACE)) {
-
- 
-    status[acknum] = ACKED;
-
-    if (TRACE > 0)
-      printf("----A: ACK %d is within window and marked as ACKED.\n", acknum);
-    
-	has_unacked = 0;
-  
-	while (status[base] == ACKED) {
-      if (TRACE > 0)
-        printf("----A: Sliding window, base %d -> %d\n", base, (base + 1) % SEQSPACE);
-      status[base] = NOT_SENT;
-      base = (base + 1) % SEQSPACE;
-    }
-	
-	
-    for (i = 0; i < WINDOWSIZE; i++) {
-      int idx = (base + i) % SEQSPACE;
-      if (status[idx] == SENT_NOT_ACKED) {
-        has_unacked = 1;
-        break;
-    }
 }
 
-if (!has_unacked) {
-  if (TRACE > 0)
-    printf("----A: duplicate ACK received, do nothing!\n");
-  stoptimer(A);
+/* the acknum a data packet leaving the entity of r carries: with SACK the */
+/* cumulative ACK, always; else the held back ACK, if there is one.  The   */
+/* bitmap of a SACK has no room in a data packet, so it is left out       */
+static int piggyback_ack(struct simulation *sim, struct sr_receiver *r)
+{
+  int acknum;
+
+  if (!BIDIRECTIONAL || (!SACK && r->unacked == 0))
+    return NOTINUSE;
+  acknum = SACK ? r->base : r->ackseq;
+  if (r->unacked > 0)
+    TRACE_EVENT(sim, SR_PIGGYBACK, acknum, r->unacked);
+  ack_sent(sim, r);
+  return acknum;
 }
-  } else {
-    if (TRACE > 0)
-      printf("----A: corrupted ACK is received, do nothing!\n");
+
+/* send packet seq of the window again, with an up to date piggybacked ACK */
+static void resend(struct simulation *sim, struct sr_state *sr, struct sr_sender *s, int seq)
+{
+  struct pkt *p = &s->buffer[seq], *q;
+
+  if (BIDIRECTIONAL) {
+    p->acknum = piggyback_ack(sim, &sr->rcv[s->entity]);
+    p->checksum = pkt_checksum(p);
   }
+  q = pkt_alloc(sim);
+  *q = *p;
+  tolayer3_pkt(sim, s->entity, q);
+  sim_stats(sim)->packets_resent++;
+  s->retries[seq]++;
 }
 
-/* called when A's timer goes off */
-void A_timerinterrupt(void)
+/* resend the packet at base now rather than when its timer goes off */
+static void fast_retransmit(struct simulation *sim, struct sr_state *sr, struct sr_sender *s)
 {
-  int i;
-  for (i = 0; i < WINDOWSIZE; i++) {
-    int idx = (base + i) % SEQSPACE;
-    if (status[idx] == SENT_NOT_ACKED) {
-      tolayer3(A, buffer[idx]);
-      if (TRACE > 0)
-        printf("----A: Timeout, resent packet %d\n", buffer[idx].seqnum);
-    }
+  int seq = s->base;
+
+  TRACE_EVENT(sim, SR_A_FASTREXMIT, s->beyond_base, seq);
+  s->beyond_base = -1;            /* once per base */
+  resend(sim, sr, s, seq);
+  sim_stats(sim)->fast_retransmits++;
+  if (s->timer_running[seq])
+    stoptimer_id(sim, s->entity, seq);
+  starttimer_id(sim, s->entity, seq, packet_timeout(s, seq));
+  s->timer_running[seq] = true;
+  if (CWND)
+    cut_cwnd(sim, sr, s, seq, 0.0);
+}
+
+/* the packets message takes: one per MTU of its data, at least one */
+static int segments(const struct sr_state *sr, const struct msg *message)
+{
+  return message->length > sr->mtu ? (message->length + sr->mtu - 1) / sr->mtu : 1;
+}
+
+/* whether the window has room for n more packets.  The congestion window */
+/* only decides whether another message may start, so that one larger    */
+/* than it still goes out                                                 */
+static bool window_open(const struct sr_state *sr, const struct sr_sender *s, int n)
+{
+  int inflight = SEQ(sr, s->nextseqnum + sr->seqspace - s->base);
+
+  return inflight + n <= sr->windowsize && (!CWND || inflight < (int)s->cwnd);
+}
+
+/* send length bytes of data as the next packet of the window */
+static void send_segment(struct simulation *sim, struct sr_state *sr, struct sr_sender *s,
+                         const char *data, int length, int more)
+{
+  struct pkt *p = &s->buffer[s->nextseqnum], *q;
+
+  /* create packet, in its place in the window buffer */
+  p->seqnum = s->nextseqnum;
+  p->acknum = piggyback_ack(sim, &sr->rcv[s->entity]);
+  p->length = length;
+  p->more = more;
+  memcpy(p->payload, data, length);
+  p->checksum = pkt_checksum(p);
+
+  bm_set(s->outstanding, s->nextseqnum);
+  s->sendtime[s->nextseqnum] = get_sim_time(sim);
+  s->retries[s->nextseqnum] = 0;
+
+  /* send out a copy of it; the buffer keeps the original for resends */
+  TRACE_EVENT(sim, SR_A_SENDING, p->seqnum);
+  q = pkt_alloc(sim);
+  *q = *p;
+  tolayer3_pkt(sim, s->entity, q);
+
+  /* every packet in flight has its own timer, numbered by its seqnum */
+  starttimer_id(sim, s->entity, s->nextseqnum, packet_timeout(s, s->nextseqnum));
+  s->timer_running[s->nextseqnum] = true;
+
+  s->nextseqnum = SEQ(sr, s->nextseqnum + 1);
+}
+
+/* send message as the next packets of the window, which must have room */
+static void send_message(struct simulation *sim, struct sr_state *sr, struct sr_sender *s,
+                         const struct msg *message)
+{
+  int n = segments(sr, message);
+  int i, length;
+
+  TRACE_EVENT(sim, SR_A_SEND);
+  if (n > 1)
+    TRACE_EVENT(sim, SR_A_SEGMENTS, message->length, n);
+  for (i = 0; i < n; i++) {
+    length = message->length - i * sr->mtu;
+    if (length > sr->mtu)
+      length = sr->mtu;
+    send_segment(sim, sr, s, message->data + i * sr->mtu, length, i < n - 1);
   }
+}
 
-  
-  starttimer(A, 1.0);
+/* a message from layer 5 for the sender s to send to the other side */
+static void sender_output(struct simulation *sim, struct sr_state *sr, struct sr_sender *s,
+                          const struct msg *message)
+{
+  /* if not blocked waiting on ACK, and no older message is waiting */
+  if (window_open(sr, s, segments(sr, message)) && s->queue.count == 0)
+    send_message(sim, sr, s, message);
+  else if (!sendq_put(sim, &s->queue, message)) {
+    TRACE_EVENT(sim, SR_A_FULL);
+    sim_stats(sim)->window_full++;
+  }
 }
 
+/* the ACK in acknum of packet, for the sender s */
+static void receive_ack(struct simulation *sim, struct sr_state *sr, struct sr_sender *s,
+                        const struct pkt *packet)
+{
+  struct msg message;
+  const struct msg *waiting;
+  int acknum, newacks, n, i, run;
+
+  acknum = packet->acknum;
+  sim_stats(sim)->total_ACKs_received++;
+
+  if (SACK) {
+    /* everything before acknum, and each packet of the bitmap, is in */
+    n = SEQ(sr, acknum + sr->seqspace - s->base);
+    TRACE_EVENT(sim, SR_A_SACK, acknum);
+    newacks = 0;
+    /* only those still out can be news: skip straight to each of them */
+    if (n <= sr->windowsize)
+      for (i = 0; (i += bm_find(s->outstanding, sr->seqspace, SEQ(sr, s->base + i),
+                                n - i, 1)) < n; i++)
+        newacks += mark_acked(sim, sr, s, SEQ(sr, s->base + i));
+    /* only an ACK-only packet has a bitmap; a data packet has data there */
+    if (packet->seqnum == NOTINUSE)
+      for (i = 0; i < 8 * packet->length && i < sr->windowsize; i++)
+        if (packet->payload[i / 8] & (1 << (i % 8)))
+          newacks += mark_acked(sim, sr, s, SEQ(sr, acknum + 1 + i));
+  }
+  else {
+    TRACE_EVENT(sim, SR_A_ACK, acknum);
+    newacks = mark_acked(sim, sr, s, acknum);
+  }
+
+  if (newacks > 0) {
+    sim_stats(sim)->new_ACKs++;
+    /* base moves past the run of ACKed packets it starts */
+    run = bm_clear_run(s->acked, sr->seqspace, s->base, sr->windowsize);
+    if (run > 0)
+      s->beyond_base = 0;
+    if (s->recover >= 0 && run >= SEQ(sr, s->recover + sr->seqspace - s->base))
+      s->recover = -1;            /* the loss event is over */
+    for (i = 0; i < run; i++)
+      TRACE_EVENT(sim, SR_A_SLIDE, SEQ(sr, s->base + i), SEQ(sr, s->base + i + 1));
+    s->base = SEQ(sr, s->base + run);
+    /* base is still missing yet the peer has later packets: it is probably lost */
+    if (FAST_RETRANSMIT > 0 && bm_test(s->outstanding, s->base) &&
+        s->beyond_base >= 0 && acked_beyond_base(sr, s) &&
+        ++s->beyond_base >= FAST_RETRANSMIT)
+      fast_retransmit(sim, sr, s);
+    if (CWND)
+      open_cwnd(sim, sr, s, newacks);
+    /* the window has moved on: send what has been waiting for it */
+    while ((waiting = sendq_peek(&s->queue)) != NULL && window_open(sr, s, segments(sr, waiting))) {
+      sendq_get(sim, &s->queue, &message);
+      send_message(sim, sr, s, &message);
+    }
+  }
+  else {
+    TRACE_EVENT(sim, SR_A_DUPACK);
+  }
+}
 
+/* the timer of packet seq of sender s went off: resend just that packet */
+static void sender_timeout(struct simulation *sim, struct sr_state *sr, struct sr_sender *s, int seq)
+{
+  TRACE_EVENT(sim, SR_A_TIMEOUT, s->buffer[seq].seqnum);
+  resend(sim, sr, s, seq);
+  starttimer_id(sim, s->entity, seq, packet_timeout(s, seq));
+  if (CWND)
+    cut_cwnd(sim, sr, s, seq, 1.0);
+}
 
+/* the arrays and queue of s, for the window and sequence space of sr */
+static void sender_alloc(struct simulation *sim, struct sr_state *sr, struct sr_sender *s)
+{
+  s->buffer = realloc_window(s->buffer, sr->seqspace, sizeof(struct pkt));
+  s->outstanding = realloc_window(s->outstanding, BM_WORDS(sr->seqspace), sizeof(uint64_t));
+  s->acked = realloc_window(s->acked, BM_WORDS(sr->seqspace), sizeof(uint64_t));
+  s->timer_running = realloc_window(s->timer_running, sr->seqspace, sizeof(bool));
+  s->sendtime = realloc_window(s->sendtime, sr->seqspace, sizeof(float));
+  s->retries = realloc_window(s->retries, sr->seqspace, sizeof(int));
+  sendq_init(&s->queue, sim_config(sim)->queuesize);
+}
 
-void A_init(void)
+static void sender_init(struct simulation *sim, struct sr_state *sr, struct sr_sender *s, int entity)
 {
   int i;
-  base = 0;
-  nextseqnum = 0;
 
-  for (i = 0; i < SEQSPACE; i++) {
-	  timer_running[i] = false;
-      status[i] = NOT_SENT;
+  s->entity = entity;
+  sender_alloc(sim, sr, s);
+
+  s->base = 0;
+  s->nextseqnum = 0;
+  s->rto = RTT;
+  s->rtt_measured = false;
+  s->beyond_base = 0;
+  s->recover = -1;
+  if (entity == A)
+    sim_stats(sim)->current_RTO = s->rto;
+  if (CWND) {
+    s->cwnd = 1.0;
+    s->ssthresh = sr->windowsize;
+    if (entity == A)
+      sim_stats(sim)->cwnd = s->cwnd;
   }
-  
-  starttimer(A, 1.0);
 
-  if (TRACE > 0)
-    printf("----A: Sender initialized.\n");
+  for (i = 0; i < sr->seqspace; i++)
+    s->timer_running[i] = false;
+
+  TRACE_EVENT(sim, SR_A_INIT);
+}
+
+/* write the sender s to a checkpoint, or read it back */
+static void sender_io(struct simulation *sim, struct ckpt *ck, struct sr_state *sr, struct sr_sender *s)
+{
+  if (ck->reading)
+    sender_alloc(sim, sr, s);
+  CKPT_IO(ck, s->entity);
+  ckpt_io(ck, s->buffer, sr->seqspace * sizeof(struct pkt));
+  ckpt_io(ck, s->outstanding, BM_WORDS(sr->seqspace) * sizeof(uint64_t));
+  ckpt_io(ck, s->acked, BM_WORDS(sr->seqspace) * sizeof(uint64_t));
+  CKPT_IO(ck, s->base);
+  ckpt_io(ck, s->timer_running, sr->seqspace * sizeof(bool));
+  CKPT_IO(ck, s->nextseqnum);
+  ckpt_io(ck, s->sendtime, sr->seqspace * sizeof(float));
+  ckpt_io(ck, s->retries, sr->seqspace * sizeof(int));
+  CKPT_IO(ck, s->srtt);
+  CKPT_IO(ck, s->rttvar);
+  CKPT_IO(ck, s->rto);
+  CKPT_IO(ck, s->rtt_measured);
+  CKPT_IO(ck, s->beyond_base);
+  sendq_io(ck, &s->queue);
+  CKPT_IO(ck, s->cwnd);
+  CKPT_IO(ck, s->ssthresh);
+  CKPT_IO(ck, s->recover);
 }
 
 
 
-/********* Receiver (B)  variables and procedures ************/
+/********* Receiver variables and procedures ************/
+
+
+
+/* send an ACK-only packet for packet seq back to the peer; with SACK, */
+/* one for everything the receiver r holds                             */
+static void send_ack(struct simulation *sim, struct sr_state *sr, struct sr_receiver *r, int seq)
+{
+  struct pkt *ackpkt = pkt_alloc(sim);   /* the ACK is not kept, so build it in place */
+  int acknum, nbits;
+#if TRACE_MODE != TRACE_OFF
+  int nsacked = 0;                       /* only the trace shows it */
+#endif
+
+  /* base itself has not arrived, or it would have been delivered */
+  acknum = SACK ? r->base : seq;
+  ackpkt->seqnum = NOTINUSE;
+  ackpkt->acknum = acknum;
+  ackpkt->length = 0;
+  ackpkt->more = 0;
+  memset(ackpkt->payload, 0, sizeof(ackpkt->payload));
+  if (SACK) {
+    nbits = sr->windowsize - 1;
+    if (nbits > SACKBITS)
+      nbits = SACKBITS;
+    if (nbits > 8 * sr->mtu)
+      nbits = 8 * sr->mtu;
+#if TRACE_MODE != TRACE_OFF
+    nsacked = bm_copy(r->received, sr->seqspace, SEQ(sr, r->base + 1), nbits,
+                      (unsigned char *)ackpkt->payload);
+#else
+    bm_copy(r->received, sr->seqspace, SEQ(sr, r->base + 1), nbits, (unsigned char *)ackpkt->payload);
+#endif
+    ackpkt->length = (nbits + 7) / 8;
+  }
+  ackpkt->checksum = pkt_checksum(ackpkt);
+  tolayer3_pkt(sim, r->entity, ackpkt);   /* no longer ours to read */
 
+  /* a SACK covers any that were being held back; a plain ACK only itself */
+  if (SACK || (r->unacked > 0 && seq == r->ackseq))
+    ack_sent(sim, r);
 
+  if (SACK)
+    TRACE_EVENT(sim, SR_B_SACK, acknum, nsacked);
+  else
+    TRACE_EVENT(sim, SR_B_ACK, acknum);
+}
 
-/* called from layer 3, when a packet arrives for layer 4 at B*/
-void B_input(struct pkt packet)
+/* hold back the ACK of the receiver r; it goes out with the next data */
+/* packet, in a later SACK, or when the delayed ACK timer goes off     */
+static void hold_ack(struct simulation *sim, struct sr_receiver *r)
 {
-	int seq;
-	struct pkt ackpkt;
-	int i;
-   if (packet.checksum != ComputeChecksum(packet)) {
-    if (TRACE > 0)
-      printf("----B: packet %d is correctly received, send ACK!\n",packet.seqnum);
+  TRACE_EVENT(sim, SR_B_HOLDACK, r->unacked);
+  if (!r->timer_running) {
+    starttimer(sim, r->entity, ACK_DELAY);
+    r->timer_running = true;
+  }
+}
+
+/* add packet, the next in order, to the message being reassembled; */
+/* pass that up to layer 5 once its last segment is in              */
+static void reassemble(struct simulation *sim, struct sr_receiver *r, const struct pkt *packet)
+{
+  struct msg *m = &r->partial;
+
+  if (m->length + packet->length > MAXMSG) {
+    printf("a reassembled message is larger than MAXMSG (%d bytes)\n", MAXMSG);
+    exit(EXIT_FAILURE);
+  }
+  memcpy(m->data + m->length, packet->payload, packet->length);
+  m->length += packet->length;
+  if (packet->more) {
+    TRACE_EVENT(sim, SR_B_SEGMENT, packet->seqnum, m->length);
     return;
   }
+  TRACE_EVENT(sim, SR_B_DELIVER, packet->seqnum);
+  tolayer5(sim, r->entity, m->data, m->length);
+  m->length = 0;
+}
 
-  seq = packet.seqnum;
+/* pass the n packets from base on up to layer 5.  Each stretch of them */
+/* that are whole messages goes in one tolayer5_batch(), straight from  */
+/* the buffer; it ends at a segment, or where the buffer wraps around   */
+static void deliver(struct simulation *sim, struct sr_state *sr, struct sr_receiver *r, int n)
+{
+  int i, k, seq;
+
+  for (i = 0; i < n; i += k) {
+    seq = SEQ(sr, r->base + i);
+    for (k = 0; i + k < n && seq + k < sr->seqspace && r->partial.length == 0 &&
+                !r->buffer[seq + k].more; k++)
+      TRACE_EVENT(sim, SR_B_DELIVER, seq + k);
+    if (k > 0)
+      tolayer5_batch(sim, r->entity, &r->buffer[seq], k);
+    else {
+      reassemble(sim, r, &r->buffer[seq]);
+      k = 1;
+    }
+  }
+}
+
+/* the data packet with seqnum seq, for the receiver r */
+static void receive_data(struct simulation *sim, struct sr_state *sr, struct sr_receiver *r,
+                         const struct pkt *packet)
+{
+  int seq, fresh, delivered;
 
-  if ((seq < B_base && B_base - seq > SEQSPACE / 2) ||
-      (seq >= B_base && seq < (B_base + WINDOWSIZE) % SEQSPACE)) {
+  seq = packet->seqnum;
 
-    if (TRACE > 0)
-      printf("----B: Packet %d within receive window.\n", seq);
+  if (SEQ(sr, seq + sr->seqspace - r->base) < sr->windowsize) {
+    TRACE_EVENT(sim, SR_B_INWINDOW, seq);
 
-    if (B_received[seq] == 0) {
-      B_buffer[seq] = packet;
-      B_received[seq] = 1;
-      if (TRACE > 0)
-        printf("----B: Cached packet %d\n", seq);
+    fresh = !bm_test(r->received, seq);
+    if (fresh) {
+      r->buffer[seq] = *packet;
+      bm_set(r->received, seq);
+      sim_stats(sim)->packets_received++;
+      TRACE_EVENT(sim, SR_B_CACHED, seq);
     } else {
-      if (TRACE > 0)
-        printf("----B: Duplicate packet %d, already cached.\n", seq);
+      TRACE_EVENT(sim, SR_B_DUP, seq);
     }
 
-    
-    ackpkt.seqnum = 0;
-    ackpkt.acknum = seq;
-	
-    for (i = 0; i < 20; i++) ackpkt.payload[i] = 0;
-    ackpkt.checksum = ComputeChecksum(ackpkt);
-    tolayer3(B, ackpkt);
-
-    if (TRACE > 0)
-      printf("----B: Sent ACK %d\n", ackpkt.acknum);
-    while (B_received[B_base] == 1) {
-      if (TRACE > 0)
-        printf("----B: Delivering packet %d to layer 5\n", B_base);
-      tolayer5(B, B_buffer[B_base].payload);
-      B_received[B_base] = 0;
-      B_base = (B_base + 1) % SEQSPACE;
+    /* a plain ACK names one packet, so only one can be held back at a time */
+    if (!SACK && ACK_HOLD > 1 && fresh) {
+      if (r->unacked > 0)
+        send_ack(sim, sr, r, r->ackseq);
+      r->ackseq = seq;
+      r->unacked = 1;
+      hold_ack(sim, r);
     }
-  
-  } else {
-    if (TRACE > 0)
-      printf("----B: Packet %d outside receive window, ignored.\n", seq);
+    else if (!SACK)
+      send_ack(sim, sr, r, seq);
+
+    /* deliver the run of packets base starts */
+    delivered = bm_clear_run(r->received, sr->seqspace, r->base, sr->windowsize);
+    deliver(sim, sr, r, delivered);
+    r->base = SEQ(sr, r->base + delivered);
+
+    /* a SACK describes the receiver once the in-order packets have been */
+    /* delivered.  Only a new packet that arrived in order may wait for  */
+    /* company; one that leaves or fills a gap, or a duplicate, is news  */
+    /* for the sender at once                                            */
+    if (SACK && fresh && delivered == 1 && ++r->unacked < ACK_HOLD)
+      hold_ack(sim, r);
+    else if (SACK)
+      send_ack(sim, sr, r, seq);
+  }
+  else if (SEQ(sr, r->base + sr->seqspace - seq) <= sr->windowsize) {
+    /* already delivered: its ACK was lost, so the sender is still retransmitting */
+    TRACE_EVENT(sim, SR_B_REACK, seq);
+    send_ack(sim, sr, r, seq);
+  }
+  else {
+    TRACE_EVENT(sim, SR_B_OUTSIDE, seq);
+  }
+}
+
+/* the delayed ACK timer of the receiver r went off: send what is held back */
+static void receiver_timeout(struct simulation *sim, struct sr_state *sr, struct sr_receiver *r)
+{
+  r->timer_running = false;
+  if (r->unacked > 0) {
+    TRACE_EVENT(sim, SR_B_ACKTIMER, r->unacked);
+    send_ack(sim, sr, r, SACK ? SEQ(sr, r->base + sr->seqspace - 1) : r->ackseq);
   }
 }
 
+static void receiver_alloc(struct sr_state *sr, struct sr_receiver *r)
+{
+  r->buffer = realloc_window(r->buffer, sr->seqspace, sizeof(struct pkt));
+  r->received = realloc_window(r->received, BM_WORDS(sr->seqspace), sizeof(uint64_t));
+}
+
+static void receiver_init(struct simulation *sim, struct sr_state *sr, struct sr_receiver *r, int entity)
+{
+  r->entity = entity;
+  receiver_alloc(sr, r);
+
+  r->base = 0;
+  r->unacked = 0;
+  r->timer_running = false;
+  r->partial.length = 0;
+
+  (void)sim;                    /* only the trace uses it */
+  TRACE_EVENT(sim, SR_B_INIT);
+}
+
+/* write the receiver r to a checkpoint, or read it back */
+static void receiver_io(struct ckpt *ck, struct sr_state *sr, struct sr_receiver *r)
+{
+  if (ck->reading)
+    receiver_alloc(sr, r);
+  CKPT_IO(ck, r->entity);
+  ckpt_io(ck, r->buffer, sr->seqspace * sizeof(struct pkt));
+  ckpt_io(ck, r->received, BM_WORDS(sr->seqspace) * sizeof(uint64_t));
+  CKPT_IO(ck, r->base);
+  CKPT_IO(ck, r->unacked);
+  CKPT_IO(ck, r->ackseq);
+  CKPT_IO(ck, r->timer_running);
+  CKPT_IO(ck, r->partial);
+}
+
+/* a packet from layer 3 for entity AorB: an ACK for its sender, data for */
+/* its receiver or, in a bidirectional build, data with an ACK on board  */
+static void entity_input(struct simulation *sim, int AorB, const struct pkt *packet)
+{
+  struct sr_state *sr = state(sim);
+
+  if (pkt_corrupted(packet)) {
+    if (AorB == A)
+      TRACE_EVENT(sim, SR_A_BADACK);
+    else
+      TRACE_EVENT(sim, SR_B_CORRUPT);
+    return;
+  }
+  if (packet->acknum != NOTINUSE)
+    receive_ack(sim, sr, &sr->snd[AorB], packet);
+  if (packet->seqnum != NOTINUSE)
+    receive_data(sim, sr, &sr->rcv[AorB], packet);
+}
+
+
+
+/********* The entry points of the emulator ************/
+
+
+
+/* called from layer 5 (application layer), passed the message to be sent to other side */
+static void A_output(struct simulation *sim, struct msg message)
+{
+  struct sr_state *sr = state(sim);
+
+  sender_output(sim, sr, &sr->snd[A], &message);
+}
+
+/* called from layer 3, when a packet arrives for layer 4 at A: an ACK,  */
+/* or in a bidirectional build data from B, which may carry an ACK too */
+static void A_input(struct simulation *sim, const struct pkt *packet)
+{
+  entity_input(sim, A, packet);
+}
+
+/* called when A's single timer goes off: its receiver's delayed ACK timer */
+static void A_timerinterrupt(struct simulation *sim)
+{
+  struct sr_state *sr = state(sim);
+
+  receiver_timeout(sim, sr, &sr->rcv[A]);
+}
+
+/* called when the timer of packet seq goes off: resend just that packet */
+static void A_timerinterrupt_id(struct simulation *sim, int seq)
+{
+  struct sr_state *sr = state(sim);
+
+  sender_timeout(sim, sr, &sr->snd[A], seq);
+}
+
+/* the following routine will be called once (only) before any other */
+/* entity A routines are called. You can use it to do any initialization */
+static void A_init(struct simulation *sim)
+{
+  struct sr_state *sr = state(sim);
+
+  sr_configure(sim, sr);
+  sender_init(sim, sr, &sr->snd[A], A);
+  if (BIDIRECTIONAL)
+    receiver_init(sim, sr, &sr->rcv[A], A);
+}
+
+/* called from layer 3, when a packet arrives for layer 4 at B */
+static void B_input(struct simulation *sim, const struct pkt *packet)
+{
+  entity_input(sim, B, packet);
+}
+
 /* the following routine will be called once (only) before any other */
 /* entity B routines are called. You can use it to do any initialization */
-void B_init(void)
+static void B_init(struct simulation *sim)
 {
-  int i;
-  B_base = 0;
-  
-  for (i = 0; i < SEQSPACE; i++) {
-    B_received[i] = 0;
-  }
+  struct sr_state *sr = state(sim);
+
+  sr_configure(sim, sr);
+  receiver_init(sim, sr, &sr->rcv[B], B);
+  if (BIDIRECTIONAL)
+    sender_init(sim, sr, &sr->snd[B], B);
+}
 
-  if (TRACE > 0)
-    printf("----B: Receiver initialized.\n");
+/* only called in a bidirectional build: a message for B to send to A */
+static void B_output(struct simulation *sim, struct msg message)
+{
+  struct sr_state *sr = state(sim);
+
+  sender_output(sim, sr, &sr->snd[B], &message);
 }
 
-/******************************************************************************
- * The following functions need be completed only for bi-directional messages *
- *****************************************************************************/
+/* called when B's single timer goes off: its receiver's delayed ACK timer */
+static void B_timerinterrupt(struct simulation *sim)
+{
+  struct sr_state *sr = state(sim);
+
+  receiver_timeout(sim, sr, &sr->rcv[B]);
+}
 
-/* Note that with simplex transfer from a-to-B, there is no B_output() */
-void B_output(struct msg message)
+/* called when the timer of packet seq of B's sender goes off */
+static void B_timerinterrupt_id(struct simulation *sim, int seq)
 {
+  struct sr_state *sr = state(sim);
+
+  sender_timeout(sim, sr, &sr->snd[B], seq);
 }
 
-/* called when B's timer goes off */
-void B_timerinterrupt(void)
+/* the entities to or from a checkpoint.  One written by a build with */
+/* other options would be misread, so the file records them           */
+static void checkpoint(struct simulation *sim, struct ckpt *ck)
 {
+  static const int options[] = { BIDIRECTIONAL, SACK, ACK_EVERY, FAST_RETRANSMIT, CWND, ADAPTIVE_RTO };
+  int built[sizeof(options) / sizeof(options[0])];
+  struct sr_state *sr = state(sim);
+
+  memcpy(built, options, sizeof(built));
+  CKPT_IO(ck, built);
+  if (memcmp(built, options, sizeof(built)) != 0) {
+    printf("the checkpoint is of Selective Repeat built with other options\n");
+    exit(EXIT_FAILURE);
+  }
+  if (ck->reading)
+    sr_configure(sim, sr);
+  sender_io(sim, ck, sr, &sr->snd[A]);
+  receiver_io(ck, sr, &sr->rcv[B]);
+  if (BIDIRECTIONAL) {
+    sender_io(sim, ck, sr, &sr->snd[B]);
+    receiver_io(ck, sr, &sr->rcv[A]);
+  }
 }
+
+const struct protocol sr_protocol = {
+  BIDIRECTIONAL,
+  A_output, A_input, A_timerinterrupt, A_timerinterrupt_id, A_init,
+  B_output, B_input, B_timerinterrupt, B_timerinterrupt_id, B_init,
+  checkpoint
+};
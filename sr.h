@@ -1,13 +1,9 @@
-extern void A_init(void);
-extern void B_init(void);
-extern void A_input(struct pkt);
-extern void B_input(struct pkt);
-extern void A_output(struct msg);
-extern void A_timerinterrupt(void);
+#ifndef SR_H
+#define SR_H
 
-/* included for extension to bidirectional communication */
-#define BIDIRECTIONAL 0       /*  0 = A->B  1 =  A<->B */
-extern void B_output(struct msg);
-extern void B_timerinterrupt(void);
+#include "protocol.h"
 
-float get_sim_time(void);
\ No newline at end of file
+/* Selective Repeat, bidirectional when built with -DBIDIRECTIONAL=1 */
+extern const struct protocol sr_protocol;
+
+#endif
@@ -0,0 +1,218 @@
+/* ******************************************************************
+   Parameter sweep driver for the network emulator.
+
+   Every emulator setting can be given a comma separated list of
+   values; the sweep simulates every combination on a pool of worker
+   threads, as many as there are cores (or --jobs).  Each run is its
+   own struct simulation, with its own clock, event list, protocol
+   state and random number stream, so runs never interfere.  The
+   end-of-run statistics of all runs are written as one CSV table, in
+   grid order, on stdout.
+
+   usage: sweep [--jobs N] [--reps R] [--name v1,v2,... ...]
+     e.g. sweep --msgs 10000 --loss 0,0.1,0.2 --lambda 10,20 --window 4,8,16
+
+   --reps R runs every grid point R times with seeds seed, seed+1, ...
+   so each replication of every point sees the same random stream.
+
+   Build with: gcc -pthread -DEMULATOR_NO_MAIN -o sweep sweep.c emulator.c evqueue.c trace.c evlog.c rng.c checksum.c sendq.c histogram.c bitmap.c channel.c checkpoint.c gbn.c sr.c -lm
+**********************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "emulator.h"
+
+#define MAXDIMS 16
+
+/* one swept setting and its comma separated values */
+struct dimension {
+  const char *name;
+  char *values;           /* the list, with the commas replaced by '\0' */
+  const char *value[64];  /* start of each value */
+  int nvalues;
+};
+
+static struct dimension dims[MAXDIMS];
+static int ndims = 0;
+static int reps = 1;
+static unsigned long baseseed = 9999;
+
+/* the results, one per grid point, and the next point to hand out */
+static struct sim_stats *results;
+static long njobs;
+static long nextjob = 0;
+static pthread_mutex_t joblock = PTHREAD_MUTEX_INITIALIZER;
+
+/* settings every run gets unless the sweep overrides them, so that the
+   emulator never has to prompt for anything */
+static const char *defaults[][2] = {
+  { "msgs", "1000" }, { "loss", "0.0" }, { "corrupt", "0.0" },
+  { "direction", "2" }, { "lambda", "50.0" }, { "trace", "0" },
+};
+
+static void usage(const char *prog)
+{
+  printf("usage: %s [--jobs N] [--reps R] [--name v1,v2,... ...]\n", prog);
+  printf("  any emulator setting (see sr --help) may be given a list of values\n");
+}
+
+static void add_dimension(struct simulation *check, const char *name, char *list)
+{
+  struct dimension *d;
+  char *p;
+
+  if (ndims == MAXDIMS) {
+    printf("too many swept settings\n");
+    exit(EXIT_FAILURE);
+  }
+  d = &dims[ndims++];
+  d->name = name;
+  d->values = list;
+  d->nvalues = 0;
+  for (p = strtok(list, ","); p != NULL; p = strtok(NULL, ",")) {
+    if (d->nvalues == (int)(sizeof(d->value) / sizeof(d->value[0]))) {
+      printf("too many values for --%s\n", name);
+      exit(EXIT_FAILURE);
+    }
+    /* checked here, in the driver, so a typo fails before any run starts */
+    if (!sim_setting(check, name, p)) {
+      printf("bad value for --%s: %s\n", name, p);
+      exit(EXIT_FAILURE);
+    }
+    d->value[d->nvalues++] = p;
+  }
+  if (d->nvalues == 0) {
+    printf("no values for --%s\n", name);
+    exit(EXIT_FAILURE);
+  }
+}
+
+/* apply the settings of job k; the last dimension varies fastest */
+static void configure(struct simulation *sim, long k)
+{
+  char seedtext[32];
+  int i;
+
+  for (i = 0; i < (int)(sizeof(defaults) / sizeof(defaults[0])); i++)
+    sim_setting(sim, defaults[i][0], defaults[i][1]);
+  sprintf(seedtext, "%lu", baseseed + (unsigned long)(k % reps));
+  sim_setting(sim, "seed", seedtext);
+  k /= reps;
+  for (i = ndims - 1; i >= 0; i--) {
+    sim_setting(sim, dims[i].name, dims[i].value[k % dims[i].nvalues]);
+    k /= dims[i].nvalues;
+  }
+}
+
+/* body of a worker thread: run grid points until there are none left */
+static void *worker(void *unused)
+{
+  struct simulation *sim;
+  long k;
+
+  (void)unused;
+  for (;;) {
+    pthread_mutex_lock(&joblock);
+    k = nextjob++;
+    pthread_mutex_unlock(&joblock);
+    if (k >= njobs)
+      return NULL;
+    sim = sim_create();
+    configure(sim, k);
+    sim_run(sim);
+    results[k] = *sim_stats(sim);
+    sim_destroy(sim);
+  }
+}
+
+static void print_csv(void)
+{
+  struct sim_stats *st;
+  unsigned long seed;
+  long k, rest;
+  int i, idx[MAXDIMS];
+
+  for (i = 0; i < ndims; i++)
+    printf("%s,", dims[i].name);
+  printf("seed,sim_time,msgs_sent,window_full,new_ACKs,packets_resent,fast_retransmits,packets_received,"
+         "messages_delivered,tolayer3,lost,corrupt,rto,cwnd,msgs_queued,queue_delay,peak_queue,"
+         "events,peak_events,goodput,latency_mean,latency_p50,latency_p95,latency_p99,"
+         "latency_max,avg_inflight,throughput,deliveries,peak_batch,dropped\n");
+  for (k = 0; k < njobs; k++) {
+    seed = baseseed + (unsigned long)(k % reps);
+    rest = k / reps;
+    for (i = ndims - 1; i >= 0; i--) {
+      idx[i] = (int)(rest % dims[i].nvalues);
+      rest /= dims[i].nvalues;
+    }
+    for (i = 0; i < ndims; i++)
+      printf("%s,", dims[i].value[idx[i]]);
+    printf("%lu,", seed);
+    st = &results[k];
+    printf("%f,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%f,%f,%d,%f,%d,%d,%d,%f,%f,%f,%f,%f,%f,%f,%f,%d,%d,%d\n", st->sim_time, st->nsim,
+           st->window_full, st->new_ACKs, st->packets_resent, st->fast_retransmits, st->packets_received,
+           st->messages_delivered, st->ntolayer3, st->nlost, st->ncorrupt,
+           st->current_RTO, st->cwnd, st->msgs_queued, st->queue_delay, st->peak_queue,
+           st->nevents, st->peak_events, st->goodput, st->latency_mean, st->latency_p50,
+           st->latency_p95, st->latency_p99, st->latency_max, st->avg_inflight,
+           st->throughput, st->deliveries, st->peak_batch, st->ndropped);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  struct simulation *check;
+  pthread_t *threads;
+  int i, nthreads;
+
+  nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  check = sim_create();
+  for (i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--", 2) != 0 || i + 1 >= argc) {
+      usage(argv[0]);
+      exit(EXIT_FAILURE);
+    }
+    if (strcmp(argv[i], "--jobs") == 0)
+      nthreads = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--reps") == 0)
+      reps = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--seed") == 0)
+      baseseed = strtoul(argv[++i], NULL, 10);
+    else {
+      add_dimension(check, argv[i] + 2, argv[i + 1]);
+      i++;
+    }
+  }
+  sim_destroy(check);
+  if (nthreads < 1)
+    nthreads = 1;
+  if (reps < 1)
+    reps = 1;
+
+  njobs = reps;
+  for (i = 0; i < ndims; i++)
+    njobs *= dims[i].nvalues;
+  if (nthreads > njobs)
+    nthreads = (int)njobs;
+  results = calloc(njobs, sizeof(struct sim_stats));
+  threads = calloc(nthreads, sizeof(pthread_t));
+  if (results == NULL || threads == NULL) {
+    printf("memory allocation for jobs failed.");
+    exit(EXIT_FAILURE);
+  }
+
+  for (i = 0; i < nthreads; i++)
+    if (pthread_create(&threads[i], NULL, worker, NULL) != 0) {
+      printf("cannot start worker thread\n");
+      exit(EXIT_FAILURE);
+    }
+  for (i = 0; i < nthreads; i++)
+    pthread_join(threads[i], NULL);
+
+  print_csv();
+  free(threads);
+  free(results);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,98 @@
+/* ******************************************************************
+   The trace message table, and packing and printing of trace records.
+   Shared by the emulator (see sim_trace()) and by tracedump, which
+   reads binary traces and needs nothing else of the emulator.
+**********************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include "trace.h"
+
+struct trace_def {
+  const char *args;           /* 'i' int, 'f' double, 'p' payload */
+  const char *format;
+};
+
+static const struct trace_def trace_defs[TRACE_NMSGS] = {
+#define TRACEMSG(name, level, args, format) { args, format },
+#include "tracemsgs.h"
+#undef TRACEMSG
+};
+
+void trace_pack(struct trace_rec *rec, int msg, va_list ap)
+{
+  const char *a;
+  unsigned char *p = rec->arg;
+  int i;
+  double d;
+  const char *payload;
+
+  rec->msg = (unsigned int)msg;
+  for (a = trace_defs[msg].args; *a != '\0'; a++) {
+    if (*a == 'i') {
+      i = va_arg(ap, int);
+      memcpy(p, &i, sizeof(i));
+      p += sizeof(i);
+    }
+    else if (*a == 'f') {
+      d = va_arg(ap, double);
+      memcpy(p, &d, sizeof(d));
+      p += sizeof(d);
+    }
+    else {
+      payload = va_arg(ap, const char *);
+      memcpy(p, payload, TRACE_PAYLOAD);
+      p += TRACE_PAYLOAD;
+    }
+  }
+}
+
+void trace_print(FILE *f, const struct trace_rec *rec)
+{
+  const unsigned char *p = rec->arg;
+  const char *s, *text;
+  int i;
+  double d;
+
+  if (rec->msg >= TRACE_NMSGS) {
+    fprintf(f, "<unknown trace message %u>\n", rec->msg);
+    return;
+  }
+  s = trace_defs[rec->msg].format;
+  while (*s != '\0') {
+    for (text = s; *s != '\0' && *s != '%'; s++)
+      ;
+    fwrite(text, 1, (size_t)(s - text), f);
+    if (*s == '\0')
+      break;
+    switch (s[1]) {
+    case 'd':
+      memcpy(&i, p, sizeof(i));
+      p += sizeof(i);
+      fprintf(f, "%d", i);
+      break;
+    case 'f':
+      memcpy(&d, p, sizeof(d));
+      p += sizeof(d);
+      fprintf(f, "%f", d);
+      break;
+    case 'P':
+      /* byte for byte, as the emulator's %c loops print payloads */
+      fwrite(p, 1, TRACE_PAYLOAD, f);
+      p += TRACE_PAYLOAD;
+      break;
+    default:
+      fputc(s[1], f);
+      break;
+    }
+    s += 2;
+  }
+}
+
+void trace_make_header(struct trace_header *h)
+{
+  memset(h, 0, sizeof(*h));
+  memcpy(h->magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+  h->recsize = sizeof(struct trace_rec);
+  h->nmsgs = TRACE_NMSGS;
+}
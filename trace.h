@@ -0,0 +1,95 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdarg.h>
+
+/* ******************************************************************
+   Tracing of the emulator and the protocol entities.
+
+   Every trace point names a message of tracemsgs.h:
+
+       TRACE_EVENT(sim, SR_A_SLIDE, base, next);
+
+   and is shown when the trace level of sim is at least the level of
+   the message.  What that costs is chosen when compiling, with
+   -DTRACE_MODE=...:
+
+   TRACE_TEXT    (the default) the text is printed on stdout at once,
+                 exactly as the emulator always has.
+   TRACE_BINARY  the message number and its arguments are stored in a
+                 ring of fixed size records, written out in blocks to
+                 --tracefile; nothing is formatted while simulating.
+                 tracedump turns such a file back into the text.
+   TRACE_OFF     trace points compile to nothing, and their arguments
+                 are not even evaluated: for benchmarks.
+**********************************************************************/
+
+#define TRACE_OFF     0
+#define TRACE_TEXT    1
+#define TRACE_BINARY  2
+
+#ifndef TRACE_MODE
+#define TRACE_MODE TRACE_TEXT
+#endif
+
+/* message numbers TM_name and the levels TL_name they are shown from */
+enum trace_msg {
+#define TRACEMSG(name, level, args, format) TM_##name,
+#include "tracemsgs.h"
+#undef TRACEMSG
+  TRACE_NMSGS
+};
+
+enum trace_level {
+#define TRACEMSG(name, level, args, format) TL_##name = level,
+#include "tracemsgs.h"
+#undef TRACEMSG
+  TL_NONE = 0
+};
+
+#define TRACE_ARGBYTES 36     /* room for the arguments of any message */
+#define TRACE_PAYLOAD  20     /* size of a 'p' argument */
+
+/* one trace message as stored in a binary trace */
+struct trace_rec {
+  unsigned int msg;                      /* enum trace_msg */
+  unsigned char arg[TRACE_ARGBYTES];     /* its arguments, packed in order */
+};
+
+/* a binary trace file starts with this, then holds trace_recs */
+struct trace_header {
+  char magic[8];                         /* TRACE_MAGIC */
+  unsigned int recsize;                  /* sizeof(struct trace_rec) */
+  unsigned int nmsgs;                    /* TRACE_NMSGS of the writer */
+};
+
+#define TRACE_MAGIC "SIMTRC1"
+
+/* store the arguments of message msg, passed as for sim_trace(), in rec */
+extern void trace_pack(struct trace_rec *rec, int msg, va_list ap);
+
+/* print rec on f as its text */
+extern void trace_print(FILE *f, const struct trace_rec *rec);
+
+/* fill in the header binary traces of this build start with */
+extern void trace_make_header(struct trace_header *h);
+
+/* emit message msg of sim, with the arguments its args string lists. */
+/* Call it through TRACE_EVENT, which checks the level first           */
+struct simulation;
+extern void sim_trace(struct simulation *, int msg, ...);
+
+#if TRACE_MODE == TRACE_OFF
+#define TRACE_EVENT(...) ((void)0)
+#else
+/* the 0 keeps the ... of TRACE_EVENT_ non-empty for argumentless messages */
+#define TRACE_EVENT(...) TRACE_EVENT_(__VA_ARGS__, 0)
+#define TRACE_EVENT_(sim, name, ...)                          \
+  do {                                                        \
+    if (sim_config(sim)->trace >= TL_##name)                  \
+      sim_trace(sim, TM_##name, __VA_ARGS__);                 \
+  } while (0)
+#endif
+
+#endif
@@ -0,0 +1,47 @@
+/* ******************************************************************
+   Decoder of binary emulator traces.
+
+   A simulator built with -DTRACE_MODE=TRACE_BINARY writes its trace
+   messages to --tracefile as records instead of text; tracedump
+   prints them as the text a TRACE_TEXT build would have shown.
+
+   usage: tracedump [file]      (reads stdin if no file is given)
+
+   Build with: gcc -o tracedump tracedump.c trace.c
+**********************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "trace.h"
+
+int main(int argc, char **argv)
+{
+  struct trace_header h, want;
+  struct trace_rec rec;
+  FILE *f = stdin;
+
+  if (argc > 2) {
+    printf("usage: %s [file]\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  if (argc == 2 && (f = fopen(argv[1], "rb")) == NULL) {
+    printf("cannot open trace file %s\n", argv[1]);
+    exit(EXIT_FAILURE);
+  }
+
+  trace_make_header(&want);
+  if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, want.magic, sizeof(h.magic)) != 0) {
+    printf("not a binary trace file\n");
+    exit(EXIT_FAILURE);
+  }
+  if (h.recsize != want.recsize || h.nmsgs > want.nmsgs) {
+    printf("trace file was written by a different version of the emulator\n");
+    exit(EXIT_FAILURE);
+  }
+
+  while (fread(&rec, sizeof(rec), 1, f) == 1)
+    trace_print(stdout, &rec);
+  if (f != stdin)
+    fclose(f);
+  return EXIT_SUCCESS;
+}
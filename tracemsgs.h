@@ -0,0 +1,93 @@
+/* ******************************************************************
+   The trace messages of the emulator and the protocol entities.
+
+   TRACEMSG(name, level, args, format) describes one message: it is
+   shown when the trace level is at least level.  args lists the
+   arguments it takes, in order: 'i' an int, 'f' a double, 'p' a
+   20 byte payload.  In format %d, %f and %P (all 20 payload bytes,
+   as they are) stand for them, in the same order.
+
+   This file is included several times (see trace.h and trace.c), so
+   it has no include guard.  New messages go at the end, so that the
+   numbers of the old ones, which binary traces store, stay the same.
+**********************************************************************/
+
+/* emulator */
+TRACEMSG(RAND,           4, "f",    "RANDOM NUMBER GENERAION CALLED: %f\n")
+TRACEMSG(INSERTEVENT,    3, "ff",   "            INSERTEVENT: time is %f\n"
+                                    "            INSERTEVENT: future time will be %f\n")
+TRACEMSG(NEXT_ARRIVAL,   3, "",     "          GENERATE NEXT ARRIVAL: creating new arrival\n")
+TRACEMSG(STOP_TIMER,     2, "f",    "          STOP TIMER: stopping timer at %f\n")
+TRACEMSG(START_TIMER,    2, "f",    "          START TIMER: starting timer at %f\n")
+TRACEMSG(STOP_TIMER_ID,  2, "if",   "          STOP TIMER %d: stopping timer at %f\n")
+TRACEMSG(START_TIMER_ID, 2, "if",   "          START TIMER %d: starting timer at %f\n")
+TRACEMSG(L3_LOST,        1, "",     "          TOLAYER3: packet being lost\n")
+TRACEMSG(L3_PACKET,      3, "iiip", "          TOLAYER3: seq: %d, ack %d, check: %d %P\n")
+TRACEMSG(L3_CORRUPT,     1, "",     "          TOLAYER3: packet being corrupted\n")
+TRACEMSG(L3_SCHEDULE,    3, "",     "          TOLAYER3: scheduling arrival on other side\n")
+TRACEMSG(L5_DATA_A,      3, "p",    "          TOLAYER5: data received by application at A: %P\n")
+TRACEMSG(L5_DATA_B,      3, "p",    "          TOLAYER5: data received by application at B: %P\n")
+TRACEMSG(EVENT_TIMER,    2, "fi",   "\nEVENT time: %f,  type: 0, timerinterrupt   entity: %d\n")
+TRACEMSG(EVENT_LAYER5,   2, "fi",   "\nEVENT time: %f,  type: 1, fromlayer5  entity: %d\n")
+TRACEMSG(EVENT_LAYER3,   2, "fi",   "\nEVENT time: %f,  type: 2, fromlayer3  entity: %d\n")
+TRACEMSG(MAIN_DATA,      3, "p",    "          MAINLOOP: data given to student: %P\n")
+TRACEMSG(NO_MORE_MSGS,   3, "",     "          FROM_LAYER5: no more messages to send: \n")
+
+/* Go-Back-N entities */
+TRACEMSG(GBN_A_SEND,     2, "",     "----A: New message arrives, send window is not full, send new messge to layer3!\n")
+TRACEMSG(GBN_A_SENDING,  1, "i",    "Sending packet %d to layer 3\n")
+TRACEMSG(GBN_A_FULL,     1, "",     "----A: New message arrives, send window is full\n")
+TRACEMSG(GBN_A_ACK,      1, "i",    "----A: uncorrupted ACK %d is received\n")
+TRACEMSG(GBN_A_NEWACK,   1, "i",    "----A: ACK %d is not a duplicate\n")
+TRACEMSG(GBN_A_DUPACK,   1, "",     "----A: duplicate ACK received, do nothing!\n")
+TRACEMSG(GBN_A_BADACK,   1, "",     "----A: corrupted ACK is received, do nothing!\n")
+TRACEMSG(GBN_A_TIMEOUT,  1, "",     "----A: time out,resend packets!\n")
+TRACEMSG(GBN_A_RESEND,   1, "i",    "---A: resending packet %d\n")
+TRACEMSG(GBN_B_RECEIVED, 1, "i",    "----B: packet %d is correctly received, send ACK!\n")
+TRACEMSG(GBN_B_REACK,    1, "",     "----B: packet corrupted or not expected sequence number, resend ACK!\n")
+
+/* Selective Repeat entities */
+TRACEMSG(SR_A_SEND,      2, "",     "----A: New message arrives, send window is not full, send new messge to layer3!\n")
+TRACEMSG(SR_A_SENDING,   1, "i",    "Sending packet %d to layer 3\n")
+TRACEMSG(SR_A_FULL,      1, "",     "----A: New message arrives, send window is full\n")
+TRACEMSG(SR_A_BADACK,    1, "",     "----A: corrupted ACK is received, do nothing!\n")
+TRACEMSG(SR_A_ACK,       1, "i",    "----A: uncorrupted ACK %d is received\n")
+TRACEMSG(SR_A_ACKED,     1, "i",    "----A: ACK %d is within window and marked as ACKED.\n")
+TRACEMSG(SR_A_SLIDE,     1, "ii",   "----A: Sliding window, base %d -> %d\n")
+TRACEMSG(SR_A_DUPACK,    1, "",     "----A: duplicate ACK received, do nothing!\n")
+TRACEMSG(SR_A_TIMEOUT,   1, "i",    "----A: Timeout, resent packet %d\n")
+TRACEMSG(SR_A_INIT,      1, "",     "----A: Sender initialized.\n")
+TRACEMSG(SR_B_ACK,       1, "i",    "----B: Sent ACK %d\n")
+TRACEMSG(SR_B_CORRUPT,   1, "",     "----B: packet corrupted, do nothing!\n")
+TRACEMSG(SR_B_INWINDOW,  1, "i",    "----B: Packet %d within receive window.\n")
+TRACEMSG(SR_B_CACHED,    1, "i",    "----B: Cached packet %d\n")
+TRACEMSG(SR_B_DUP,       1, "i",    "----B: Duplicate packet %d, already cached.\n")
+TRACEMSG(SR_B_DELIVER,   1, "i",    "----B: Delivering packet %d to layer 5\n")
+TRACEMSG(SR_B_REACK,     1, "i",    "----B: Packet %d already delivered, ACK again.\n")
+TRACEMSG(SR_B_OUTSIDE,   1, "i",    "----B: Packet %d outside receive window, ignored.\n")
+TRACEMSG(SR_B_INIT,      1, "",     "----B: Receiver initialized.\n")
+TRACEMSG(SR_A_SACK,      1, "i",    "----A: uncorrupted SACK received, cumulative ACK %d\n")
+TRACEMSG(SR_B_SACK,      1, "ii",   "----B: Sent cumulative ACK %d with %d selective\n")
+TRACEMSG(SR_B_HOLDACK,   1, "i",    "----B: Holding back the ACK, %d packets unACKed\n")
+TRACEMSG(SR_B_ACKTIMER,  1, "i",    "----B: Delayed ACK timer, ACK %d packets\n")
+TRACEMSG(SR_A_FASTREXMIT,1, "ii",   "----A: %d ACKs beyond base, fast retransmit of packet %d\n")
+
+/* sender side message queue */
+TRACEMSG(SENDQ_PUT,      1, "i",    "----A: window is full, message queued (%d waiting)\n")
+TRACEMSG(SENDQ_GET,      1, "fi",   "----A: window open, sending a message queued for %f (%d still waiting)\n")
+TRACEMSG(SR_A_CWND,      1, "ff",   "----A: loss, congestion window %f, slow start threshold %f\n")
+TRACEMSG(SR_PIGGYBACK,   1, "ii",   "----B: ACK %d rides on a data packet (%d held back)\n")
+
+/* segmentation and reassembly of messages larger than the MTU */
+TRACEMSG(SR_A_SEGMENTS,  1, "ii",   "----A: Message of %d bytes sent as %d segments\n")
+TRACEMSG(SR_B_SEGMENT,   1, "ii",   "----B: Segment %d held for reassembly, %d bytes of the message so far\n")
+
+/* several connections sharing the medium (--flows) */
+TRACEMSG(CONNECTION,     2, "i",    "          CONNECTION %d\n")
+
+/* the link model of the medium (--channel link) */
+TRACEMSG(L3_DROPPED,     1, "",     "          TOLAYER3: packet dropped, the link's buffer is full\n")
+
+/* checkpoints of a run (--checkpoint, --restore) */
+TRACEMSG(CHECKPOINT,     1, "f",    "          CHECKPOINT: state up to time %f written\n")
+TRACEMSG(RESTORED,       1, "f",    "          RESTORED: state up to time %f read back from a checkpoint\n")